@@ -1,12 +1,37 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
 
+//Set per pipeline from PipelineDescription::shaderFeatures. Branches on these are resolved when the
+//pipeline is built, so each variant only contains the code it uses.
+layout(constant_id = 0) const bool TEXTURED = true;
+layout(constant_id = 1) const bool VERTEX_COLOR = false;
+layout(constant_id = 2) const bool ALPHA_TEST = false;
+layout(constant_id = 3) const bool FOG = false;
+layout(constant_id = 4) const float ALPHA_CUTOFF = 0.5;
+layout(constant_id = 5) const float FOG_START = 2.0;
+layout(constant_id = 6) const float FOG_END = 6.0;
+
 layout(location = 0) in vec3 fragColor;
 layout(location = 1) in vec2 fragTexCoord;
-layout(binding = 1) uniform sampler2D texSampler;
+layout(location = 2) in float fragViewDepth;
+//Per material
+layout(set = 1, binding = 0) uniform sampler2D texSampler;
 
 layout(location = 0) out vec4 outColor;
 
 void main() {
-    outColor = texture(texSampler, fragTexCoord);
-}
\ No newline at end of file
+    vec4 color = vec4(1.0);
+    if(TEXTURED)
+        color *= texture(texSampler, fragTexCoord);
+    if(VERTEX_COLOR)
+        color.rgb *= fragColor;
+    if(ALPHA_TEST && color.a < ALPHA_CUTOFF)
+        discard;
+    if(FOG)
+    {
+        //Fade to the clear color
+        float visibility = clamp((FOG_END - fragViewDepth) / (FOG_END - FOG_START), 0.0, 1.0);
+        color.rgb *= visibility;
+    }
+    outColor = color;
+}
@@ -1,21 +1,35 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
 
-layout(binding = 0) uniform UniformBufferObject {
-    mat4 model;
+//Per frame
+layout(set = 0, binding = 0) uniform UniformBufferObject {
     mat4 view;
     mat4 proj;
 } ubo;
 
+//Per draw, at a dynamic offset into one buffer holding every object
+layout(set = 2, binding = 0) uniform ObjectUniforms {
+    mat4 model;
+} objectUniforms;
+
+//Per draw
+layout(push_constant) uniform ObjectPushConstants {
+    uint objectId;
+    uint materialId;    //Only read by shader_bindless.frag
+} object;
+
 layout(location = 0) in vec3 inPosition;
 layout(location = 1) in vec3 inColor;
 layout(location = 2) in vec2 inTexCoord;
 
 layout(location = 0) out vec3 fragColor;
 layout(location = 1) out vec2 fragTexCoord;
+layout(location = 2) out float fragViewDepth;
 
 void main() {
-    gl_Position = ubo.proj * ubo.view * ubo.model * vec4(inPosition, 1.0);
+    vec4 viewPosition = ubo.view * objectUniforms.model * vec4(inPosition, 1.0);
+    gl_Position = ubo.proj * viewPosition;
     fragColor = inColor;
     fragTexCoord = inTexCoord;
+    fragViewDepth = -viewPosition.z;
 }
\ No newline at end of file
@@ -0,0 +1,52 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_EXT_nonuniform_qualifier : require
+
+//shader.frag for bindless materials: every texture in the scene sits in one array, and each draw picks
+//its own with the material ID it pushes, so the material set is bound once per frame instead of per material.
+
+//Set per pipeline from PipelineDescription::shaderFeatures. Branches on these are resolved when the
+//pipeline is built, so each variant only contains the code it uses.
+layout(constant_id = 0) const bool TEXTURED = true;
+layout(constant_id = 1) const bool VERTEX_COLOR = false;
+layout(constant_id = 2) const bool ALPHA_TEST = false;
+layout(constant_id = 3) const bool FOG = false;
+layout(constant_id = 4) const float ALPHA_CUTOFF = 0.5;
+layout(constant_id = 5) const float FOG_START = 2.0;
+layout(constant_id = 6) const float FOG_END = 6.0;
+
+layout(location = 0) in vec3 fragColor;
+layout(location = 1) in vec2 fragTexCoord;
+layout(location = 2) in float fragViewDepth;
+//Per material, shared by all of them. samplers[] is immutable, one per CommonSampler in main.cpp; only the texture slots materials use are written.
+layout(set = 1, binding = 0) uniform sampler samplers[4];
+layout(set = 1, binding = 1) uniform texture2D textures[];
+
+//Per draw. Low 24 bits of materialId are the textures index, high 8 bits the samplers index.
+layout(push_constant) uniform ObjectPushConstants {
+    uint objectId;
+    uint materialId;
+} object;
+
+layout(location = 0) out vec4 outColor;
+
+void main() {
+    vec4 color = vec4(1.0);
+    if(TEXTURED)
+    {
+        uint textureIndex = object.materialId & 0xFFFFFF;
+        uint samplerIndex = object.materialId >> 24;
+        color *= texture(sampler2D(textures[nonuniformEXT(textureIndex)], samplers[nonuniformEXT(samplerIndex)]), fragTexCoord);
+    }
+    if(VERTEX_COLOR)
+        color.rgb *= fragColor;
+    if(ALPHA_TEST && color.a < ALPHA_CUTOFF)
+        discard;
+    if(FOG)
+    {
+        //Fade to the clear color
+        float visibility = clamp((FOG_END - fragViewDepth) / (FOG_END - FOG_START), 0.0, 1.0);
+        color.rgb *= visibility;
+    }
+    outColor = color;
+}
@@ -0,0 +1,43 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+//Same interface as shader.vert, so pipelines using either share one pipeline layout. Each instance brings
+//its own transform, so objectUniforms and the push constants are declared but unused here.
+layout(set = 0, binding = 0) uniform UniformBufferObject {
+    mat4 view;
+    mat4 proj;
+} ubo;
+
+layout(set = 2, binding = 0) uniform ObjectUniforms {
+    mat4 model;
+} objectUniforms;
+
+layout(push_constant) uniform ObjectPushConstants {
+    uint objectId;
+    uint materialId;
+} object;
+
+//Per vertex (Vertex)
+layout(location = 0) in vec3 inPosition;
+layout(location = 1) in vec3 inColor;
+layout(location = 2) in vec2 inTexCoord;
+
+//Per instance (InstanceData). The model matrix comes in a column per location.
+layout(location = 3) in vec4 inModel0;
+layout(location = 4) in vec4 inModel1;
+layout(location = 5) in vec4 inModel2;
+layout(location = 6) in vec4 inModel3;
+layout(location = 7) in vec4 inInstanceColor;
+
+layout(location = 0) out vec3 fragColor;
+layout(location = 1) out vec2 fragTexCoord;
+layout(location = 2) out float fragViewDepth;
+
+void main() {
+    mat4 model = mat4(inModel0, inModel1, inModel2, inModel3);
+    vec4 viewPosition = ubo.view * model * vec4(inPosition, 1.0);
+    gl_Position = ubo.proj * viewPosition;
+    fragColor = inColor * inInstanceColor.rgb;
+    fragTexCoord = inTexCoord;
+    fragViewDepth = -viewPosition.z;
+}
@@ -0,0 +1,273 @@
+//Standalone CPU frustum culling benchmark for frustum_culling.h. Culls a field of random bounding spheres and boxes
+//against a camera frustum with the scalar kernels, the SIMD ones this build picked (AVX, SSE or none), and the SIMD
+//ones split across a thread pool, and reports objects culled per millisecond. No SDL or Vulkan needed.
+//The exit code is nonzero if any kernel's visible list differs from the scalar one.
+//Build (Linux): g++ -O2 -mavx -std=c++11 -pthread benchmarks/culling_bench.cpp -o culling_bench
+//Usage: culling_bench [--objects <n>] [--iterations <n>] [--threads <n>]
+#include "../frustum_culling.h"
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <cmath>
+#include <cstdlib>
+
+#define FIELD_EXTENT 500.0f     //Objects are spread over a cube this far from the origin on each axis
+#define CAMERA_FOV_DEGREES 60.0f
+#define CAMERA_ASPECT (16.0f / 9.0f)
+
+enum CullMode
+{
+    MODE_SPHERES_SCALAR,
+    MODE_SPHERES_SIMD,
+    MODE_SPHERES_THREADED,
+    MODE_BOXES_SCALAR,
+    MODE_BOXES_SIMD,
+    MODE_BOXES_THREADED,
+    MODE_COUNT
+};
+
+static const char* modeNames[MODE_COUNT] = {
+    "Spheres scalar",
+    "Spheres SIMD",
+    "Spheres threaded",
+    "Boxes scalar",
+    "Boxes SIMD",
+    "Boxes threaded"
+};
+
+struct BenchOptions
+{
+    uint32_t objects = 1000000;
+    uint32_t iterations = 50;
+    uint32_t threads = 0;       //0 for the thread pool's default
+};
+
+//Column-major 4x4, out = a * b
+static void multiply(const float* a, const float* b, float* out)
+{
+    for(int column = 0; column < 4; column++)
+    {
+        for(int row = 0; row < 4; row++)
+        {
+            float sum = 0.0f;
+            for(int k = 0; k < 4; k++)
+                sum += a[k * 4 + row] * b[column * 4 + k];
+            out[column * 4 + row] = sum;
+        }
+    }
+}
+
+//Right handed, 0 to 1 depth, like glm::perspective with GLM_FORCE_DEPTH_ZERO_TO_ONE
+static void perspective(float fovy, float aspect, float zNear, float zFar, float* out)
+{
+    float tanHalfFovy = std::tan(fovy * 0.5f);
+    std::fill(out, out + 16, 0.0f);
+    out[0] = 1.0f / (aspect * tanHalfFovy);
+    out[5] = 1.0f / tanHalfFovy;
+    out[10] = zFar / (zNear - zFar);
+    out[11] = -1.0f;
+    out[14] = -(zFar * zNear) / (zFar - zNear);
+}
+
+static void normalize(float* v)
+{
+    float length = std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+    for(int i = 0; i < 3; i++)
+        v[i] /= length;
+}
+
+static void cross(const float* a, const float* b, float* out)
+{
+    out[0] = a[1] * b[2] - a[2] * b[1];
+    out[1] = a[2] * b[0] - a[0] * b[2];
+    out[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+//Like glm::lookAt
+static void lookAt(const float* eye, const float* center, const float* up, float* out)
+{
+    float f[3] = { center[0] - eye[0], center[1] - eye[1], center[2] - eye[2] };
+    normalize(f);
+    float s[3];
+    cross(f, up, s);
+    normalize(s);
+    float u[3];
+    cross(s, f, u);
+
+    std::fill(out, out + 16, 0.0f);
+    for(int i = 0; i < 3; i++)
+    {
+        out[i * 4 + 0] = s[i];
+        out[i * 4 + 1] = u[i];
+        out[i * 4 + 2] = -f[i];
+    }
+    out[12] = -(s[0] * eye[0] + s[1] * eye[1] + s[2] * eye[2]);
+    out[13] = -(u[0] * eye[0] + u[1] * eye[1] + u[2] * eye[2]);
+    out[14] = f[0] * eye[0] + f[1] * eye[1] + f[2] * eye[2];
+    out[15] = 1.0f;
+}
+
+//From one corner of the field looking at the middle, so a good share of objects are visible and a good share aren't
+static FrustumPlanes createCameraFrustum()
+{
+    float eye[3] = { -FIELD_EXTENT, -FIELD_EXTENT * 0.5f, FIELD_EXTENT * 0.25f };
+    float center[3] = { 0.0f, 0.0f, 0.0f };
+    float up[3] = { 0.0f, 0.0f, 1.0f };
+    float view[16], proj[16], viewProj[16];
+    lookAt(eye, center, up, view);
+    perspective(CAMERA_FOV_DEGREES * 3.14159265f / 180.0f, CAMERA_ASPECT, 0.1f, FIELD_EXTENT * 2.5f, proj);
+    multiply(proj, view, viewProj);
+    return extractFrustumPlanes(viewProj);
+}
+
+//Fixed seed, so runs are comparable
+static void createObjects(uint32_t count, BoundingSpheres& spheres, BoundingBoxes& boxes)
+{
+    std::mt19937 random(1);
+    std::uniform_real_distribution<float> position(-FIELD_EXTENT, FIELD_EXTENT);
+    std::uniform_real_distribution<float> halfSize(0.5f, 5.0f);
+
+    spheres.reserve(count);
+    boxes.reserve(count);
+    for(uint32_t i = 0; i < count; i++)
+    {
+        float x = position(random);
+        float y = position(random);
+        float z = position(random);
+        float halfX = halfSize(random);
+        float halfY = halfSize(random);
+        float halfZ = halfSize(random);
+        spheres.add(x, y, z, std::sqrt(halfX * halfX + halfY * halfY + halfZ * halfZ));
+        boxes.add(x - halfX, y - halfY, z - halfZ, x + halfX, y + halfY, z + halfZ);
+    }
+}
+
+static double percentile(const std::vector<double>& sorted, double p)
+{
+    if(sorted.empty())
+        return 0.0;
+    size_t index = (size_t)(p * (sorted.size() - 1) + 0.5);
+    return sorted[std::min(index, sorted.size() - 1)];
+}
+
+static void printUsage(const char* program)
+{
+    std::cout << "Usage: " << program << " [--objects <n>] [--iterations <n>] [--threads <n>]" << std::endl;
+    std::cout << "\t--objects     Bounding spheres and boxes culled per pass (default: 1000000)" << std::endl;
+    std::cout << "\t--iterations  Passes timed per mode, after one warm-up pass (default: 50)" << std::endl;
+    std::cout << "\t--threads     Threads for the threaded modes (default: one less than the core count)" << std::endl;
+}
+
+static BenchOptions parseOptions(int argc, char** argv)
+{
+    BenchOptions options;
+    for(int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if(arg == "--objects" && hasValue)
+            options.objects = (uint32_t)std::max(1, atoi(argv[++i]));
+        else if(arg == "--iterations" && hasValue)
+            options.iterations = (uint32_t)std::max(1, atoi(argv[++i]));
+        else if(arg == "--threads" && hasValue)
+            options.threads = (uint32_t)std::min(std::max(1, atoi(argv[++i])), 256);
+        else
+        {
+            printUsage(argv[0]);
+            exit(arg == "--help" ? 0 : 1);
+        }
+    }
+    return options;
+}
+
+int main(int argc, char** argv)
+{
+    BenchOptions options = parseOptions(argc, argv);
+
+    BoundingSpheres spheres;
+    BoundingBoxes boxes;
+    createObjects(options.objects, spheres, boxes);
+    FrustumPlanes frustum = createCameraFrustum();
+
+    ThreadPool threadPool(options.threads);
+    ParallelFrustumCuller culler;
+    size_t chunkCount = threadPool.getThreadCount();
+
+    std::cout << "Culling " << options.objects << " object(s) x " << options.iterations << " pass(es), "
+        << getFrustumCullingPath() << " kernels, " << chunkCount << " thread(s) for threaded modes" << std::endl;
+
+    std::cout << std::endl << std::left << std::setw(18) << "Mode"
+        << std::right << std::setw(10) << "p50 ms" << std::setw(10) << "p90 ms" << std::setw(14) << "objects/ms"
+        << std::setw(10) << "visible" << std::setw(12) << "vs scalar" << std::endl;
+    std::cout << std::fixed << std::setprecision(3);
+
+    std::vector<uint32_t> visible;
+    std::vector<uint32_t> scalarVisible;
+    double scalarMs = 0.0;
+    bool allMatch = true;
+    for(int mode = 0; mode < MODE_COUNT; mode++)
+    {
+        //Capacity is kept between passes, as it would be frame to frame
+        std::vector<double> passMs;
+        for(uint32_t iteration = 0; iteration <= options.iterations; iteration++)
+        {
+            auto startTime = std::chrono::high_resolution_clock::now();
+            switch(mode)
+            {
+            case MODE_SPHERES_SCALAR:
+                visible.clear();
+                cullSpheresScalar(frustum, spheres, 0, spheres.size(), visible);
+                break;
+            case MODE_SPHERES_SIMD:
+                visible.clear();
+                cullSpheres(frustum, spheres, 0, spheres.size(), visible);
+                break;
+            case MODE_SPHERES_THREADED:
+                culler.cullSpheres(frustum, spheres, threadPool, chunkCount, visible);
+                break;
+            case MODE_BOXES_SCALAR:
+                visible.clear();
+                cullBoxesScalar(frustum, boxes, 0, boxes.size(), visible);
+                break;
+            case MODE_BOXES_SIMD:
+                visible.clear();
+                cullBoxes(frustum, boxes, 0, boxes.size(), visible);
+                break;
+            case MODE_BOXES_THREADED:
+                culler.cullBoxes(frustum, boxes, threadPool, chunkCount, visible);
+                break;
+            }
+            auto endTime = std::chrono::high_resolution_clock::now();
+            if(iteration > 0)
+                passMs.push_back(std::chrono::duration<double, std::milli>(endTime - startTime).count());
+        }
+        std::sort(passMs.begin(), passMs.end());
+
+        double p50 = percentile(passMs, 0.50);
+        if(mode == MODE_SPHERES_SCALAR || mode == MODE_BOXES_SCALAR)
+        {
+            scalarMs = p50;
+            scalarVisible = visible;
+        }
+        else if(visible != scalarVisible)
+        {
+            std::cout << modeNames[mode] << " visible list differs from scalar" << std::endl;
+            allMatch = false;
+        }
+
+        std::cout << std::left << std::setw(18) << modeNames[mode]
+            << std::right << std::setw(10) << p50
+            << std::setw(10) << percentile(passMs, 0.90)
+            << std::setw(14) << std::setprecision(0) << (p50 > 0.0 ? options.objects / p50 : 0.0)
+            << std::setw(10) << visible.size()
+            << std::setw(11) << std::setprecision(2) << (p50 > 0.0 ? scalarMs / p50 : 0.0) << "x" << std::setprecision(3) << std::endl;
+    }
+
+    return allMatch ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,448 @@
+//Standalone descriptor binding benchmark. Measures the CPU cost of recording a texture change per draw three ways:
+//allocating and writing a fresh set each time, looking sets up in DescriptorSetCache, and VK_KHR_push_descriptor.
+//Headless: needs a Vulkan driver but no window or SDL. Command buffers are only recorded, never submitted, and hold
+//binds without draws, so the numbers are descriptor overhead alone.
+//Build (Linux): g++ -O2 -std=c++11 benchmarks/descriptor_bench.cpp -o descriptor_bench -lvulkan
+//Usage: descriptor_bench [--draws <n>] [--textures <n>] [--iterations <n>] [--device <index>]
+#include <vulkan/vulkan.h>
+#include "../descriptor_allocator.h"
+#include "../descriptor_set_cache.h"
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+
+#define DESCRIPTOR_POOL_INITIAL_SETS 16  //Pools double from here as they fill up
+
+enum BindMode
+{
+    MODE_UPDATE,
+    MODE_CACHED,
+    MODE_PUSH,
+    MODE_COUNT
+};
+
+static const char* modeNames[MODE_COUNT] = {
+    "Allocate+update",
+    "Cached sets",
+    "Push descriptors"
+};
+
+struct BenchOptions
+{
+    uint32_t draws = 10000;
+    uint32_t textures = 64;
+    uint32_t iterations = 50;
+    uint32_t deviceIndex = 0;
+};
+
+struct BenchContext
+{
+    VkInstance instance = VK_NULL_HANDLE;
+    VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+    VkDevice device = VK_NULL_HANDLE;
+    bool pushDescriptorsSupported = false;
+    PFN_vkCmdPushDescriptorSetKHR cmdPushDescriptorSet = NULL;
+    VkCommandPool commandPool = VK_NULL_HANDLE;
+    VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+    VkSampler sampler = VK_NULL_HANDLE;
+    VkDescriptorSetLayout setLayout = VK_NULL_HANDLE;
+    VkDescriptorSetLayout pushSetLayout = VK_NULL_HANDLE;
+    VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+    VkPipelineLayout pushPipelineLayout = VK_NULL_HANDLE;
+    std::vector<VkImage> images;
+    std::vector<VkDeviceMemory> imageMemory;
+    std::vector<VkImageView> imageViews;
+};
+
+static void checkResult(VkResult result, const char* what)
+{
+    if(result != VK_SUCCESS)
+    {
+        std::cout << "Failed to " << what << " (VkResult " << result << ")" << std::endl;
+        exit(1);
+    }
+}
+
+static bool hasDeviceExtension(VkPhysicalDevice physicalDevice, const char* extensionName)
+{
+    uint32_t extensionCount;
+    vkEnumerateDeviceExtensionProperties(physicalDevice, NULL, &extensionCount, NULL);
+    std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+    vkEnumerateDeviceExtensionProperties(physicalDevice, NULL, &extensionCount, availableExtensions.data());
+
+    for(const auto& extension : availableExtensions)
+    {
+        if(strcmp(extension.extensionName, extensionName) == 0)
+            return true;
+    }
+    return false;
+}
+
+static void createDevice(BenchContext& context, const BenchOptions& options)
+{
+    VkApplicationInfo appInfo = {};
+    appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+    appInfo.pApplicationName = "descriptor_bench";
+    appInfo.apiVersion = VK_API_VERSION_1_1;    //VK_KHR_push_descriptor needs 1.1 or VK_KHR_get_physical_device_properties2
+
+    VkInstanceCreateInfo instanceInfo = {};
+    instanceInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+    instanceInfo.pApplicationInfo = &appInfo;
+    checkResult(vkCreateInstance(&instanceInfo, NULL, &context.instance), "create instance");
+
+    uint32_t deviceCount = 0;
+    vkEnumeratePhysicalDevices(context.instance, &deviceCount, NULL);
+    if(options.deviceIndex >= deviceCount)
+    {
+        std::cout << "No physical device " << options.deviceIndex << " (found " << deviceCount << ")" << std::endl;
+        exit(1);
+    }
+    std::vector<VkPhysicalDevice> devices(deviceCount);
+    vkEnumeratePhysicalDevices(context.instance, &deviceCount, devices.data());
+    context.physicalDevice = devices[options.deviceIndex];
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(context.physicalDevice, &properties);
+    std::cout << "Device: " << properties.deviceName << std::endl;
+
+    //Any queue will do, since nothing is submitted; the command pool just needs a family
+    uint32_t queueFamilyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(context.physicalDevice, &queueFamilyCount, NULL);
+    std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(context.physicalDevice, &queueFamilyCount, queueFamilies.data());
+    uint32_t queueFamily = 0;
+    for(uint32_t i = 0; i < queueFamilyCount; i++)
+    {
+        if(queueFamilies[i].queueFlags & VK_QUEUE_GRAPHICS_BIT)
+        {
+            queueFamily = i;
+            break;
+        }
+    }
+
+    float queuePriority = 1.0f;
+    VkDeviceQueueCreateInfo queueInfo = {};
+    queueInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+    queueInfo.queueFamilyIndex = queueFamily;
+    queueInfo.queueCount = 1;
+    queueInfo.pQueuePriorities = &queuePriority;
+
+    std::vector<const char*> extensions;
+    context.pushDescriptorsSupported = hasDeviceExtension(context.physicalDevice, VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME);
+    if(context.pushDescriptorsSupported)
+        extensions.push_back(VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME);
+    else
+        std::cout << "VK_KHR_push_descriptor not supported; skipping that mode" << std::endl;
+
+    VkDeviceCreateInfo deviceInfo = {};
+    deviceInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+    deviceInfo.queueCreateInfoCount = 1;
+    deviceInfo.pQueueCreateInfos = &queueInfo;
+    deviceInfo.enabledExtensionCount = (uint32_t)extensions.size();
+    deviceInfo.ppEnabledExtensionNames = extensions.data();
+    checkResult(vkCreateDevice(context.physicalDevice, &deviceInfo, NULL, &context.device), "create device");
+
+    if(context.pushDescriptorsSupported)
+    {
+        context.cmdPushDescriptorSet = (PFN_vkCmdPushDescriptorSetKHR)vkGetDeviceProcAddr(context.device, "vkCmdPushDescriptorSetKHR");
+        context.pushDescriptorsSupported = (context.cmdPushDescriptorSet != NULL);
+    }
+
+    VkCommandPoolCreateInfo poolInfo = {};
+    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolInfo.queueFamilyIndex = queueFamily;
+    checkResult(vkCreateCommandPool(context.device, &poolInfo, NULL, &context.commandPool), "create command pool");
+
+    VkCommandBufferAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.commandPool = context.commandPool;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandBufferCount = 1;
+    checkResult(vkAllocateCommandBuffers(context.device, &allocInfo, &context.commandBuffer), "allocate command buffer");
+}
+
+//1x1 images; their contents don't matter since nothing samples them
+static void createTextures(BenchContext& context, uint32_t count)
+{
+    for(uint32_t i = 0; i < count; i++)
+    {
+        VkImageCreateInfo imageInfo = {};
+        imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        imageInfo.imageType = VK_IMAGE_TYPE_2D;
+        imageInfo.format = VK_FORMAT_R8G8B8A8_UNORM;
+        imageInfo.extent = { 1, 1, 1 };
+        imageInfo.mipLevels = 1;
+        imageInfo.arrayLayers = 1;
+        imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+        imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        imageInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT;
+        imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+        VkImage image;
+        checkResult(vkCreateImage(context.device, &imageInfo, NULL, &image), "create image");
+
+        VkMemoryRequirements memRequirements;
+        vkGetImageMemoryRequirements(context.device, image, &memRequirements);
+        uint32_t memoryType = 0;
+        while(memoryType < 32 && !(memRequirements.memoryTypeBits & (1u << memoryType)))
+            memoryType++;
+
+        VkMemoryAllocateInfo allocInfo = {};
+        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        allocInfo.allocationSize = memRequirements.size;
+        allocInfo.memoryTypeIndex = memoryType;
+
+        VkDeviceMemory memory;
+        checkResult(vkAllocateMemory(context.device, &allocInfo, NULL, &memory), "allocate image memory");
+        vkBindImageMemory(context.device, image, memory, 0);
+
+        VkImageViewCreateInfo viewInfo = {};
+        viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        viewInfo.image = image;
+        viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        viewInfo.format = VK_FORMAT_R8G8B8A8_UNORM;
+        viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        viewInfo.subresourceRange.levelCount = 1;
+        viewInfo.subresourceRange.layerCount = 1;
+
+        VkImageView imageView;
+        checkResult(vkCreateImageView(context.device, &viewInfo, NULL, &imageView), "create image view");
+
+        context.images.push_back(image);
+        context.imageMemory.push_back(memory);
+        context.imageViews.push_back(imageView);
+    }
+}
+
+//The app's material set: one combined image sampler with the sampler baked in
+static void createLayouts(BenchContext& context)
+{
+    VkSamplerCreateInfo samplerInfo = {};
+    samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    samplerInfo.magFilter = VK_FILTER_LINEAR;
+    samplerInfo.minFilter = VK_FILTER_LINEAR;
+    samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+    checkResult(vkCreateSampler(context.device, &samplerInfo, NULL, &context.sampler), "create sampler");
+
+    VkDescriptorSetLayoutBinding binding = {};
+    binding.binding = 0;
+    binding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    binding.descriptorCount = 1;
+    binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    binding.pImmutableSamplers = &context.sampler;
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = 1;
+    layoutInfo.pBindings = &binding;
+    checkResult(vkCreateDescriptorSetLayout(context.device, &layoutInfo, NULL, &context.setLayout), "create descriptor set layout");
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &context.setLayout;
+    checkResult(vkCreatePipelineLayout(context.device, &pipelineLayoutInfo, NULL, &context.pipelineLayout), "create pipeline layout");
+
+    if(!context.pushDescriptorsSupported)
+        return;
+
+    layoutInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_PUSH_DESCRIPTOR_BIT_KHR;
+    checkResult(vkCreateDescriptorSetLayout(context.device, &layoutInfo, NULL, &context.pushSetLayout), "create push descriptor set layout");
+    pipelineLayoutInfo.pSetLayouts = &context.pushSetLayout;
+    checkResult(vkCreatePipelineLayout(context.device, &pipelineLayoutInfo, NULL, &context.pushPipelineLayout), "create push pipeline layout");
+}
+
+static void destroyContext(BenchContext& context)
+{
+    for(size_t i = 0; i < context.images.size(); i++)
+    {
+        vkDestroyImageView(context.device, context.imageViews[i], NULL);
+        vkDestroyImage(context.device, context.images[i], NULL);
+        vkFreeMemory(context.device, context.imageMemory[i], NULL);
+    }
+    if(context.pushDescriptorsSupported)
+    {
+        vkDestroyPipelineLayout(context.device, context.pushPipelineLayout, NULL);
+        vkDestroyDescriptorSetLayout(context.device, context.pushSetLayout, NULL);
+    }
+    vkDestroyPipelineLayout(context.device, context.pipelineLayout, NULL);
+    vkDestroyDescriptorSetLayout(context.device, context.setLayout, NULL);
+    vkDestroySampler(context.device, context.sampler, NULL);
+    vkDestroyCommandPool(context.device, context.commandPool, NULL);
+    vkDestroyDevice(context.device, NULL);
+    vkDestroyInstance(context.instance, NULL);
+}
+
+//Records one frame's worth of texture changes and returns how long that took, in milliseconds.
+//Every draw uses a different texture than the last, the worst case for binding.
+static double recordFrame(BenchContext& context, BindMode mode, const BenchOptions& options, DescriptorAllocator& allocator, DescriptorSetCache& cache)
+{
+    VkDescriptorImageInfo imageInfo = {};
+    imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+    VkWriteDescriptorSet descriptorWrite = {};
+    descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrite.dstBinding = 0;
+    descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    descriptorWrite.descriptorCount = 1;
+    descriptorWrite.pImageInfo = &imageInfo;
+
+    VkCommandBufferBeginInfo beginInfo = {};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    auto start = std::chrono::high_resolution_clock::now();
+    vkBeginCommandBuffer(context.commandBuffer, &beginInfo);
+    for(uint32_t draw = 0; draw < options.draws; draw++)
+    {
+        imageInfo.imageView = context.imageViews[draw % context.imageViews.size()];
+        switch(mode)
+        {
+            case MODE_UPDATE:
+            {
+                VkDescriptorSet descriptorSet = allocator.allocate(context.setLayout);
+                if(descriptorSet == VK_NULL_HANDLE)
+                {
+                    std::cout << "Failed to allocate descriptor set" << std::endl;
+                    exit(1);
+                }
+                descriptorWrite.dstSet = descriptorSet;
+                vkUpdateDescriptorSets(context.device, 1, &descriptorWrite, 0, NULL);
+                vkCmdBindDescriptorSets(context.commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, context.pipelineLayout, 0, 1, &descriptorSet, 0, NULL);
+                break;
+            }
+            case MODE_CACHED:
+            {
+                VkDescriptorSet descriptorSet = cache.get(context.setLayout, { DescriptorResource::forImage(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, imageInfo.imageView, VK_NULL_HANDLE, imageInfo.imageLayout) });
+                if(descriptorSet == VK_NULL_HANDLE)
+                {
+                    std::cout << "Failed to get cached descriptor set" << std::endl;
+                    exit(1);
+                }
+                vkCmdBindDescriptorSets(context.commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, context.pipelineLayout, 0, 1, &descriptorSet, 0, NULL);
+                break;
+            }
+            case MODE_PUSH:
+                descriptorWrite.dstSet = VK_NULL_HANDLE;
+                context.cmdPushDescriptorSet(context.commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, context.pushPipelineLayout, 0, 1, &descriptorWrite);
+                break;
+            default:
+                break;
+        }
+    }
+    vkEndCommandBuffer(context.commandBuffer);
+    auto end = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+static double percentile(const std::vector<double>& sorted, double p)
+{
+    if(sorted.empty())
+        return 0.0;
+    size_t index = (size_t)(p * (sorted.size() - 1) + 0.5);
+    return sorted[std::min(index, sorted.size() - 1)];
+}
+
+static void printUsage(const char* program)
+{
+    std::cout << "Usage: " << program << " [--draws <n>] [--textures <n>] [--iterations <n>] [--device <index>]" << std::endl;
+    std::cout << "\t--draws       Texture changes recorded per frame (default: 10000)" << std::endl;
+    std::cout << "\t--textures    Distinct textures cycled through (default: 64)" << std::endl;
+    std::cout << "\t--iterations  Frames recorded per mode, after one warm-up frame (default: 50)" << std::endl;
+    std::cout << "\t--device      Physical device index (default: 0)" << std::endl;
+}
+
+static BenchOptions parseOptions(int argc, char** argv)
+{
+    BenchOptions options;
+    for(int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if(arg == "--draws" && hasValue)
+            options.draws = (uint32_t)std::max(1, atoi(argv[++i]));
+        else if(arg == "--textures" && hasValue)
+            options.textures = (uint32_t)std::min(std::max(1, atoi(argv[++i])), 1024);     //One allocation each; stay under maxMemoryAllocationCount
+        else if(arg == "--iterations" && hasValue)
+            options.iterations = (uint32_t)std::max(1, atoi(argv[++i]));
+        else if(arg == "--device" && hasValue)
+            options.deviceIndex = (uint32_t)std::max(0, atoi(argv[++i]));
+        else
+        {
+            printUsage(argv[0]);
+            exit(arg == "--help" ? 0 : 1);
+        }
+    }
+    return options;
+}
+
+int main(int argc, char** argv)
+{
+    BenchOptions options = parseOptions(argc, argv);
+
+    BenchContext context;
+    createDevice(context, options);
+    createTextures(context, options.textures);
+    createLayouts(context);
+
+    std::vector<DescriptorPoolRatio> ratios = { { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1.0f } };
+    DescriptorAllocator allocator;
+    allocator.init(context.device, DESCRIPTOR_POOL_INITIAL_SETS, ratios);
+    DescriptorSetCache cache;
+    cache.init(context.device, options.textures, 0, DESCRIPTOR_POOL_INITIAL_SETS, ratios);
+
+    std::cout << "Recording " << options.draws << " texture change(s) x " << options.iterations << " frame(s), "
+        << options.textures << " texture(s)" << std::endl;
+
+    std::cout << std::endl << std::left << std::setw(18) << "Mode"
+        << std::right << std::setw(10) << "p50 ms" << std::setw(10) << "p90 ms" << std::setw(10) << "max ms"
+        << std::setw(12) << "ns/draw" << std::setw(10) << "vs alloc" << std::endl;
+    std::cout << std::fixed << std::setprecision(3);
+
+    double baselineMs = 0.0;
+    for(int mode = 0; mode < MODE_COUNT; mode++)
+    {
+        if(mode == MODE_PUSH && !context.pushDescriptorsSupported)
+            continue;
+
+        //Pool and command buffer resets are per-frame costs either way, so they stay out of the timings
+        std::vector<double> frameMs;
+        for(uint32_t iteration = 0; iteration <= options.iterations; iteration++)
+        {
+            allocator.reset();
+            cache.beginFrame(iteration);
+            vkResetCommandPool(context.device, context.commandPool, 0);
+
+            double ms = recordFrame(context, (BindMode)mode, options, allocator, cache);
+            if(iteration > 0)
+                frameMs.push_back(ms);
+        }
+
+        std::sort(frameMs.begin(), frameMs.end());
+        double p50 = percentile(frameMs, 0.50);
+        if(mode == MODE_UPDATE)
+            baselineMs = p50;
+        std::cout << std::left << std::setw(18) << modeNames[mode]
+            << std::right << std::setw(10) << p50
+            << std::setw(10) << percentile(frameMs, 0.90)
+            << std::setw(10) << frameMs.back()
+            << std::setw(12) << std::setprecision(1) << p50 * 1.0e6 / options.draws
+            << std::setw(9) << std::setprecision(2) << (p50 > 0.0 ? baselineMs / p50 : 0.0) << "x" << std::setprecision(3) << std::endl;
+    }
+
+    std::cout << std::endl << "Cached sets: " << cache.getHitCount() << " hits, " << cache.getMissCount() << " misses, "
+        << allocator.getPoolCount() << " pool(s) for allocate+update" << std::endl;
+
+    cache.destroyAll();
+    allocator.destroyAll();
+    destroyContext(context);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,393 @@
+//Standalone stb_image decode benchmark. Needs no window, SDL, or Vulkan, so it runs headless.
+//Build (Linux): g++ -O2 -std=c++17 -pthread benchmarks/image_decode_bench.cpp -o image_decode_bench
+//Usage: image_decode_bench [--dir <path>] [--threads <n>] [--iterations <n>] [--input memory|file] [--rgba]
+#define STB_IMAGE_IMPLEMENTATION
+#include "../stb_image.h"
+#include "../png16.h"
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <filesystem>
+#include <string>
+#include <vector>
+#include <array>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <cctype>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+enum ImageFormat
+{
+    FORMAT_JPEG_BASELINE,
+    FORMAT_JPEG_PROGRESSIVE,
+    FORMAT_PNG_8,
+    FORMAT_PNG_16,
+    FORMAT_TGA,
+    FORMAT_HDR,
+    FORMAT_COUNT,
+    FORMAT_UNKNOWN = FORMAT_COUNT
+};
+
+static const char* formatNames[FORMAT_COUNT] = {
+    "JPEG baseline",
+    "JPEG progressive",
+    "PNG 8-bit",
+    "PNG 16-bit",
+    "TGA",
+    "HDR"
+};
+
+struct CorpusFile
+{
+    std::string path;
+    ImageFormat format;
+    std::vector<stbi_uc> contents;  //Only filled in for in-memory input
+    size_t fileSize;
+};
+
+struct FormatStats
+{
+    uint64_t decodes = 0;
+    uint64_t failures = 0;
+    uint64_t inputBytes = 0;
+    uint64_t pixels = 0;
+    std::vector<double> latenciesMs;
+
+    void merge(const FormatStats& other)
+    {
+        decodes += other.decodes;
+        failures += other.failures;
+        inputBytes += other.inputBytes;
+        pixels += other.pixels;
+        latenciesMs.insert(latenciesMs.end(), other.latenciesMs.begin(), other.latenciesMs.end());
+    }
+};
+
+struct BenchOptions
+{
+    std::string directory = "textures";
+    unsigned int threads = 1;
+    unsigned int iterations = 5;
+    bool inMemory = true;
+    int requiredComponents = 0;     //0 = decode to the file's native channel count
+};
+
+static std::vector<stbi_uc> readWholeFile(const std::string& filename)
+{
+    std::ifstream file(filename, std::ios::ate | std::ios::binary);
+    if(!file.is_open())
+        return std::vector<stbi_uc>();
+
+    size_t fileSize = (size_t)file.tellg();
+    std::vector<stbi_uc> buffer(fileSize);
+    file.seekg(0);
+    file.read((char*)buffer.data(), fileSize);
+    return buffer;
+}
+
+//Walk JPEG markers up to the first frame header to tell baseline (SOF0/SOF1) from progressive (SOF2)
+static ImageFormat classifyJpeg(const std::vector<stbi_uc>& data)
+{
+    size_t pos = 2;
+    while(pos + 4 <= data.size())
+    {
+        if(data[pos] != 0xFF)
+            return FORMAT_UNKNOWN;
+
+        stbi_uc marker = data[pos + 1];
+        if(marker == 0xFF)
+        {
+            pos++;  //Fill byte
+            continue;
+        }
+        if(marker == 0xC0 || marker == 0xC1)
+            return FORMAT_JPEG_BASELINE;
+        if(marker == 0xC2)
+            return FORMAT_JPEG_PROGRESSIVE;
+        if(marker == 0xDA)
+            return FORMAT_UNKNOWN;  //Hit scan data without a supported frame header
+
+        size_t segmentLength = ((size_t)data[pos + 2] << 8) | data[pos + 3];
+        pos += 2 + segmentLength;
+    }
+    return FORMAT_UNKNOWN;
+}
+
+static bool hasExtension(const std::string& path, const char* extension)
+{
+    std::string ext = std::filesystem::path(path).extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+    return ext == extension;
+}
+
+//Only the file header is needed to classify, so in file mode this doesn't count toward timing
+static ImageFormat classifyFile(const std::string& path, const std::vector<stbi_uc>& data)
+{
+    static const stbi_uc pngSignature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+
+    if(data.size() >= 2 && data[0] == 0xFF && data[1] == 0xD8)
+        return classifyJpeg(data);
+
+    //IHDR is always the first chunk; bit depth lives at byte 24
+    if(data.size() >= 25 && memcmp(data.data(), pngSignature, sizeof(pngSignature)) == 0)
+        return data[24] == 16 ? FORMAT_PNG_16 : FORMAT_PNG_8;
+
+    if(!data.empty() && stbi_is_hdr_from_memory(data.data(), (int)data.size()))
+        return FORMAT_HDR;
+
+    //TGA has no magic number, so fall back to the extension
+    if(hasExtension(path, ".tga"))
+        return FORMAT_TGA;
+
+    return FORMAT_UNKNOWN;
+}
+
+static std::vector<CorpusFile> loadCorpus(const BenchOptions& options)
+{
+    std::vector<CorpusFile> corpus;
+
+    std::error_code error;
+    std::filesystem::recursive_directory_iterator it(options.directory, error);
+    if(error)
+    {
+        std::cout << "Failed to open directory " << options.directory << ": " << error.message() << std::endl;
+        exit(1);
+    }
+
+    for(const auto& entry : it)
+    {
+        if(!entry.is_regular_file())
+            continue;
+
+        CorpusFile file;
+        file.path = entry.path().string();
+        std::vector<stbi_uc> contents = readWholeFile(file.path);
+        file.format = classifyFile(file.path, contents);
+        file.fileSize = contents.size();
+        if(file.format == FORMAT_UNKNOWN)
+            continue;
+
+        if(options.inMemory)
+            file.contents.swap(contents);
+        corpus.push_back(std::move(file));
+    }
+
+    //Stable order so runs are comparable
+    std::sort(corpus.begin(), corpus.end(), [](const CorpusFile& a, const CorpusFile& b) { return a.path < b.path; });
+    return corpus;
+}
+
+static bool decodeFile(const CorpusFile& file, const BenchOptions& options, int& width, int& height)
+{
+    int channels;
+    void* pixels;
+
+    if(options.inMemory)
+    {
+        const stbi_uc* buffer = file.contents.data();
+        int length = (int)file.contents.size();
+        if(file.format == FORMAT_HDR)
+            pixels = stbi_loadf_from_memory(buffer, length, &width, &height, &channels, options.requiredComponents);
+        else if(file.format == FORMAT_PNG_16)
+            pixels = loadPng16FromMemory(buffer, length, &width, &height, &channels, options.requiredComponents);
+        else
+            pixels = stbi_load_from_memory(buffer, length, &width, &height, &channels, options.requiredComponents);
+    }
+    else
+    {
+        if(file.format == FORMAT_HDR)
+            pixels = stbi_loadf(file.path.c_str(), &width, &height, &channels, options.requiredComponents);
+        else if(file.format == FORMAT_PNG_16)
+            pixels = loadPng16(file.path.c_str(), &width, &height, &channels, options.requiredComponents);
+        else
+            pixels = stbi_load(file.path.c_str(), &width, &height, &channels, options.requiredComponents);
+    }
+
+    if(pixels == NULL)
+        return false;
+
+    stbi_image_free(pixels);
+    return true;
+}
+
+static void benchWorker(const std::vector<CorpusFile>& corpus, const BenchOptions& options, std::atomic<size_t>& nextJob, std::array<FormatStats, FORMAT_COUNT>& stats)
+{
+    size_t jobCount = corpus.size() * options.iterations;
+    for(size_t job = nextJob++; job < jobCount; job = nextJob++)
+    {
+        const CorpusFile& file = corpus[job % corpus.size()];
+        FormatStats& formatStats = stats[file.format];
+
+        int width = 0, height = 0;
+        auto start = std::chrono::high_resolution_clock::now();
+        bool success = decodeFile(file, options, width, height);
+        auto end = std::chrono::high_resolution_clock::now();
+
+        if(!success)
+        {
+            formatStats.failures++;
+            continue;
+        }
+
+        formatStats.decodes++;
+        formatStats.inputBytes += file.fileSize;
+        formatStats.pixels += (uint64_t)width * height;
+        formatStats.latenciesMs.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+    }
+}
+
+static double percentile(const std::vector<double>& sorted, double p)
+{
+    if(sorted.empty())
+        return 0.0;
+    size_t index = (size_t)(p * (sorted.size() - 1) + 0.5);
+    return sorted[std::min(index, sorted.size() - 1)];
+}
+
+static long peakResidentSetKb()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if(GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return (long)(counters.PeakWorkingSetSize / 1024);
+    return -1;
+#else
+    struct rusage usage;
+    if(getrusage(RUSAGE_SELF, &usage) == 0)
+        return usage.ru_maxrss;     //Kilobytes on Linux
+    return -1;
+#endif
+}
+
+static void printUsage(const char* program)
+{
+    std::cout << "Usage: " << program << " [--dir <path>] [--threads <n>] [--iterations <n>] [--input memory|file] [--rgba]" << std::endl;
+    std::cout << "\t--dir         Directory to scan recursively for images (default: textures)" << std::endl;
+    std::cout << "\t--threads     Number of decode threads (default: 1)" << std::endl;
+    std::cout << "\t--iterations  Times each file is decoded (default: 5)" << std::endl;
+    std::cout << "\t--input       memory: preload files and decode from RAM; file: decode through stdio (default: memory)" << std::endl;
+    std::cout << "\t--rgba        Force 4 channels like the texture loader does (default: native channel count)" << std::endl;
+}
+
+static BenchOptions parseOptions(int argc, char** argv)
+{
+    BenchOptions options;
+    for(int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if(arg == "--dir" && hasValue)
+            options.directory = argv[++i];
+        else if(arg == "--threads" && hasValue)
+            options.threads = std::max(1, atoi(argv[++i]));
+        else if(arg == "--iterations" && hasValue)
+            options.iterations = std::max(1, atoi(argv[++i]));
+        else if(arg == "--input" && hasValue)
+        {
+            std::string mode = argv[++i];
+            if(mode != "memory" && mode != "file")
+            {
+                printUsage(argv[0]);
+                exit(1);
+            }
+            options.inMemory = (mode == "memory");
+        }
+        else if(arg == "--rgba")
+            options.requiredComponents = STBI_rgb_alpha;
+        else
+        {
+            printUsage(argv[0]);
+            exit(arg == "--help" ? 0 : 1);
+        }
+    }
+    return options;
+}
+
+int main(int argc, char** argv)
+{
+    BenchOptions options = parseOptions(argc, argv);
+
+    std::vector<CorpusFile> corpus = loadCorpus(options);
+    if(corpus.empty())
+    {
+        std::cout << "No supported images found in " << options.directory << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::cout << "Decoding " << corpus.size() << " file(s) x " << options.iterations << " iteration(s) on "
+        << options.threads << " thread(s), " << (options.inMemory ? "in-memory" : "file") << " input" << std::endl;
+
+    //Each thread gets its own stats so the hot loop takes no locks
+    std::vector<std::array<FormatStats, FORMAT_COUNT>> threadStats(options.threads);
+    std::vector<std::thread> workers;
+    std::atomic<size_t> nextJob(0);
+
+    auto start = std::chrono::high_resolution_clock::now();
+    for(unsigned int i = 0; i < options.threads; i++)
+        workers.emplace_back(benchWorker, std::cref(corpus), std::cref(options), std::ref(nextJob), std::ref(threadStats[i]));
+    for(auto& worker : workers)
+        worker.join();
+    auto end = std::chrono::high_resolution_clock::now();
+    double wallSeconds = std::chrono::duration<double>(end - start).count();
+
+    std::array<FormatStats, FORMAT_COUNT> stats;
+    for(const auto& perThread : threadStats)
+    {
+        for(int format = 0; format < FORMAT_COUNT; format++)
+            stats[format].merge(perThread[format]);
+    }
+
+    //Per-format throughput is per decoding thread (summed decode time); the totals line uses wall time
+    std::cout << std::endl << std::left << std::setw(18) << "Format"
+        << std::right << std::setw(9) << "Decodes" << std::setw(7) << "Fail"
+        << std::setw(10) << "MB/s" << std::setw(10) << "MP/s"
+        << std::setw(10) << "p50 ms" << std::setw(10) << "p90 ms" << std::setw(10) << "p99 ms" << std::setw(10) << "max ms" << std::endl;
+    std::cout << std::fixed << std::setprecision(2);
+
+    FormatStats total;
+    for(int format = 0; format < FORMAT_COUNT; format++)
+    {
+        FormatStats& s = stats[format];
+        if(s.decodes == 0 && s.failures == 0)
+            continue;
+
+        std::sort(s.latenciesMs.begin(), s.latenciesMs.end());
+        double decodeSeconds = 0.0;
+        for(double ms : s.latenciesMs)
+            decodeSeconds += ms / 1000.0;
+
+        double mbPerSec = decodeSeconds > 0.0 ? (s.inputBytes / (1024.0 * 1024.0)) / decodeSeconds : 0.0;
+        double mpPerSec = decodeSeconds > 0.0 ? (s.pixels / 1.0e6) / decodeSeconds : 0.0;
+        std::cout << std::left << std::setw(18) << formatNames[format]
+            << std::right << std::setw(9) << s.decodes << std::setw(7) << s.failures
+            << std::setw(10) << mbPerSec << std::setw(10) << mpPerSec
+            << std::setw(10) << percentile(s.latenciesMs, 0.50)
+            << std::setw(10) << percentile(s.latenciesMs, 0.90)
+            << std::setw(10) << percentile(s.latenciesMs, 0.99)
+            << std::setw(10) << (s.latenciesMs.empty() ? 0.0 : s.latenciesMs.back()) << std::endl;
+
+        total.merge(s);
+    }
+
+    std::cout << std::endl << "Total: " << total.decodes << " decodes (" << total.failures << " failed) in " << wallSeconds << " s, "
+        << (total.inputBytes / (1024.0 * 1024.0)) / wallSeconds << " MB/s, "
+        << (total.pixels / 1.0e6) / wallSeconds << " MP/s" << std::endl;
+
+    long peakRss = peakResidentSetKb();
+    if(peakRss >= 0)
+        std::cout << "Peak RSS: " << peakRss / 1024.0 << " MB" << std::endl;
+
+    return total.failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
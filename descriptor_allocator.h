@@ -0,0 +1,142 @@
+#pragma once
+//Hands out descriptor sets from a growing list of pools, so nothing has to be sized up front.
+//Each pool holds some number of sets, with descriptors for them in fixed per-type ratios. When a pool runs out
+//(VK_ERROR_OUT_OF_POOL_MEMORY or VK_ERROR_FRAGMENTED_POOL) the next one is made, twice the size of the last.
+//Sets are never freed one at a time: reset() recycles every pool at once, which suits transient per-frame
+//sets; long-lived sets stay until destroyAll().
+//Not thread-safe; give each thread or frame its own allocator.
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+struct DescriptorPoolRatio
+{
+    VkDescriptorType type;
+    float descriptorsPerSet;
+};
+
+class DescriptorAllocator
+{
+public:
+    //poolFlags are passed to every pool, e.g. VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT_EXT for bindless layouts
+    void init(VkDevice logicalDevice, uint32_t initialSetsPerPool, const std::vector<DescriptorPoolRatio>& poolRatios, VkDescriptorPoolCreateFlags poolFlags = 0)
+    {
+        device = logicalDevice;
+        setsPerPool = std::max(initialSetsPerPool, 1u);
+        ratios = poolRatios;
+        flags = poolFlags;
+    }
+
+    //variableDescriptorCount sizes the runtime array of a layout that has one; leave 0 otherwise.
+    //Returns VK_NULL_HANDLE on failure.
+    VkDescriptorSet allocate(VkDescriptorSetLayout layout, uint32_t variableDescriptorCount = 0)
+    {
+        if(currentPool == VK_NULL_HANDLE)
+            currentPool = grabPool();
+        if(currentPool == VK_NULL_HANDLE)
+            return VK_NULL_HANDLE;
+
+        VkDescriptorSet descriptorSet;
+        VkResult result = tryAllocate(currentPool, layout, variableDescriptorCount, descriptorSet);
+        if(result == VK_ERROR_OUT_OF_POOL_MEMORY || result == VK_ERROR_FRAGMENTED_POOL)
+        {
+            //Full; move on to a fresh pool. One that can't fit a single set won't be helped by another like it.
+            fullPools.push_back(currentPool);
+            currentPool = grabPool();
+            if(currentPool == VK_NULL_HANDLE)
+                return VK_NULL_HANDLE;
+            result = tryAllocate(currentPool, layout, variableDescriptorCount, descriptorSet);
+        }
+        return (result == VK_SUCCESS) ? descriptorSet : VK_NULL_HANDLE;
+    }
+
+    //Frees every set allocated so far. Only once the GPU is done with all of them.
+    void reset()
+    {
+        if(currentPool != VK_NULL_HANDLE)
+            fullPools.push_back(currentPool);
+        currentPool = VK_NULL_HANDLE;
+        for(VkDescriptorPool pool : fullPools)
+        {
+            vkResetDescriptorPool(device, pool, 0);
+            readyPools.push_back(pool);
+        }
+        fullPools.clear();
+    }
+
+    void destroyAll()
+    {
+        reset();
+        for(VkDescriptorPool pool : readyPools)
+            vkDestroyDescriptorPool(device, pool, NULL);
+        readyPools.clear();
+    }
+
+    size_t getPoolCount() const
+    {
+        return fullPools.size() + readyPools.size() + ((currentPool != VK_NULL_HANDLE) ? 1 : 0);
+    }
+
+private:
+    static const uint32_t MAX_SETS_PER_POOL = 4096;
+
+    VkResult tryAllocate(VkDescriptorPool pool, VkDescriptorSetLayout layout, uint32_t variableDescriptorCount, VkDescriptorSet& descriptorSet)
+    {
+        VkDescriptorSetVariableDescriptorCountAllocateInfoEXT variableCountInfo = {};
+        variableCountInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_VARIABLE_DESCRIPTOR_COUNT_ALLOCATE_INFO_EXT;
+        variableCountInfo.descriptorSetCount = 1;
+        variableCountInfo.pDescriptorCounts = &variableDescriptorCount;
+
+        VkDescriptorSetAllocateInfo allocInfo = {};
+        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.pNext = (variableDescriptorCount > 0) ? &variableCountInfo : NULL;
+        allocInfo.descriptorPool = pool;
+        allocInfo.descriptorSetCount = 1;
+        allocInfo.pSetLayouts = &layout;
+        return vkAllocateDescriptorSets(device, &allocInfo, &descriptorSet);
+    }
+
+    //Reuses a reset pool if there is one, otherwise creates the next size up
+    VkDescriptorPool grabPool()
+    {
+        if(!readyPools.empty())
+        {
+            VkDescriptorPool pool = readyPools.back();
+            readyPools.pop_back();
+            return pool;
+        }
+
+        std::vector<VkDescriptorPoolSize> poolSizes;
+        for(const DescriptorPoolRatio& ratio : ratios)
+        {
+            VkDescriptorPoolSize poolSize = {};
+            poolSize.type = ratio.type;
+            poolSize.descriptorCount = std::max((uint32_t)(ratio.descriptorsPerSet * setsPerPool), 1u);
+            poolSizes.push_back(poolSize);
+        }
+
+        VkDescriptorPoolCreateInfo poolInfo = {};
+        poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        poolInfo.flags = flags;
+        poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+        poolInfo.pPoolSizes = poolSizes.data();
+        poolInfo.maxSets = setsPerPool;
+
+        VkDescriptorPool pool;
+        if(vkCreateDescriptorPool(device, &poolInfo, NULL, &pool) != VK_SUCCESS)
+            return VK_NULL_HANDLE;
+        setsPerPool = (setsPerPool * 2 < MAX_SETS_PER_POOL) ? setsPerPool * 2 : MAX_SETS_PER_POOL;
+        return pool;
+    }
+
+    VkDevice device = VK_NULL_HANDLE;
+    uint32_t setsPerPool = 1;
+    std::vector<DescriptorPoolRatio> ratios;
+    VkDescriptorPoolCreateFlags flags = 0;
+    VkDescriptorPool currentPool = VK_NULL_HANDLE;
+    std::vector<VkDescriptorPool> fullPools;
+    std::vector<VkDescriptorPool> readyPools;
+};
@@ -0,0 +1,233 @@
+#pragma once
+//Cache of descriptor sets keyed by their layout and the resources written into them. Asking for the same
+//contents again returns the existing set with no descriptor writes, so sets can be looked up while recording
+//instead of being tracked by hand. Least recently used sets are evicted once the cache is full; their handles
+//are recycled for new contents after reuseLatency frames, so a set the GPU may still be reading is never rewritten.
+//Anything recorded with an evicted set must be re-recorded before it's submitted again (see getEvictionCount()),
+//and resources must outlive every set they're written into.
+//Safe to call from any thread.
+
+#include <vulkan/vulkan.h>
+#include "descriptor_allocator.h"
+#include "hash.h"
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+//One descriptor written into a set: a buffer range, or an image view and/or sampler, depending on type
+struct DescriptorResource
+{
+    uint32_t binding;
+    uint32_t arrayElement;
+    VkDescriptorType type;
+    VkDescriptorBufferInfo bufferInfo;
+    VkDescriptorImageInfo imageInfo;
+
+    static DescriptorResource forBuffer(uint32_t binding, VkDescriptorType type, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range)
+    {
+        DescriptorResource resource = {};
+        resource.binding = binding;
+        resource.type = type;
+        resource.bufferInfo.buffer = buffer;
+        resource.bufferInfo.offset = offset;
+        resource.bufferInfo.range = range;
+        return resource;
+    }
+
+    static DescriptorResource forImage(uint32_t binding, VkDescriptorType type, VkImageView imageView, VkSampler sampler, VkImageLayout imageLayout)
+    {
+        DescriptorResource resource = {};
+        resource.binding = binding;
+        resource.type = type;
+        resource.imageInfo.imageView = imageView;
+        resource.imageInfo.sampler = sampler;
+        resource.imageInfo.imageLayout = imageLayout;
+        return resource;
+    }
+
+    bool isBuffer() const
+    {
+        return type == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER || type == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER ||
+            type == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC || type == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+    }
+};
+
+class DescriptorSetCache
+{
+public:
+    //poolRatios should cover every layout the cache will be asked for; initialSetsPerPool is passed on to the DescriptorAllocator
+    void init(VkDevice logicalDevice, size_t maxSets, uint64_t reuseLatency, uint32_t initialSetsPerPool, const std::vector<DescriptorPoolRatio>& poolRatios)
+    {
+        device = logicalDevice;
+        capacity = (maxSets > 0) ? maxSets : 1;
+        latency = reuseLatency;
+        allocator.init(logicalDevice, initialSetsPerPool, poolRatios);
+    }
+
+    //Call once per frame, after waiting for the frame reuseLatency frames ago to finish on the GPU
+    void beginFrame(uint64_t frameNumber)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        currentFrame = frameNumber;
+        while(!retiredSets.empty() && retiredSets.front().reusableFrame <= frameNumber)
+        {
+            freeSets[retiredSets.front().layout].push_back(retiredSets.front().descriptorSet);
+            retiredSets.pop_front();
+        }
+    }
+
+    //Returns VK_NULL_HANDLE on failure
+    VkDescriptorSet get(VkDescriptorSetLayout layout, const std::vector<DescriptorResource>& resources)
+    {
+        SetKey key = makeKey(layout, resources);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        auto found = entries.find(key);
+        if(found != entries.end())
+        {
+            hits++;
+            lru.splice(lru.begin(), lru, found->second);
+            return found->second->descriptorSet;
+        }
+        misses++;
+
+        if(entries.size() >= capacity)
+        {
+            Entry& oldest = lru.back();
+            RetiredSet retired = { oldest.layout, oldest.descriptorSet, currentFrame + latency };
+            retiredSets.push_back(retired);
+            entries.erase(oldest.key);
+            lru.pop_back();
+            evictions++;
+        }
+
+        VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+        std::vector<VkDescriptorSet>& recycled = freeSets[layout];
+        if(!recycled.empty())
+        {
+            descriptorSet = recycled.back();
+            recycled.pop_back();
+        }
+        else
+            descriptorSet = allocator.allocate(layout);
+        if(descriptorSet == VK_NULL_HANDLE)
+            return VK_NULL_HANDLE;
+
+        std::vector<VkWriteDescriptorSet> descriptorWrites(resources.size());
+        for(size_t i = 0; i < resources.size(); i++)
+        {
+            VkWriteDescriptorSet& descriptorWrite = descriptorWrites[i];
+            descriptorWrite = {};
+            descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            descriptorWrite.dstSet = descriptorSet;
+            descriptorWrite.dstBinding = resources[i].binding;
+            descriptorWrite.dstArrayElement = resources[i].arrayElement;
+            descriptorWrite.descriptorType = resources[i].type;
+            descriptorWrite.descriptorCount = 1;
+            if(resources[i].isBuffer())
+                descriptorWrite.pBufferInfo = &resources[i].bufferInfo;
+            else
+                descriptorWrite.pImageInfo = &resources[i].imageInfo;
+        }
+        vkUpdateDescriptorSets(device, (uint32_t)descriptorWrites.size(), descriptorWrites.data(), 0, NULL);
+        writes += descriptorWrites.size();
+
+        Entry entry = { key, layout, descriptorSet };
+        lru.push_front(entry);
+        entries.emplace(key, lru.begin());
+        return descriptorSet;
+    }
+
+    uint64_t getHitCount() const { return hits; }
+    uint64_t getMissCount() const { return misses; }
+    uint64_t getEvictionCount() const { return evictions; }
+    uint64_t getWriteCount() const { return writes; }     //Individual descriptors written
+
+    size_t size()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return entries.size();
+    }
+
+    //Only once the GPU is done with every set
+    void destroyAll()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        entries.clear();
+        lru.clear();
+        retiredSets.clear();
+        freeSets.clear();
+        allocator.destroyAll();
+    }
+
+private:
+    typedef std::vector<uint64_t> SetKey;
+
+    struct Entry
+    {
+        SetKey key;
+        VkDescriptorSetLayout layout;
+        VkDescriptorSet descriptorSet;
+    };
+
+    struct RetiredSet
+    {
+        VkDescriptorSetLayout layout;
+        VkDescriptorSet descriptorSet;
+        uint64_t reusableFrame;
+    };
+
+    template<typename Handle>
+    static uint64_t handleWord(Handle handle)
+    {
+        uint64_t word = 0;
+        memcpy(&word, &handle, sizeof(handle));
+        return word;
+    }
+
+    static SetKey makeKey(VkDescriptorSetLayout layout, const std::vector<DescriptorResource>& resources)
+    {
+        SetKey key;
+        key.reserve(1 + resources.size() * 6);
+        key.push_back(handleWord(layout));
+        for(const DescriptorResource& resource : resources)
+        {
+            key.push_back(((uint64_t)resource.binding << 32) | resource.arrayElement);
+            key.push_back(resource.type);
+            if(resource.isBuffer())
+            {
+                key.push_back(handleWord(resource.bufferInfo.buffer));
+                key.push_back(resource.bufferInfo.offset);
+                key.push_back(resource.bufferInfo.range);
+            }
+            else
+            {
+                key.push_back(handleWord(resource.imageInfo.imageView));
+                key.push_back(handleWord(resource.imageInfo.sampler));
+                key.push_back(resource.imageInfo.imageLayout);
+            }
+        }
+        return key;
+    }
+
+    VkDevice device = VK_NULL_HANDLE;
+    size_t capacity = 1;
+    uint64_t latency = 0;
+    uint64_t currentFrame = 0;
+    DescriptorAllocator allocator;
+    std::list<Entry> lru;       //Most recently used first
+    std::unordered_map<SetKey, std::list<Entry>::iterator, WordKeyHash> entries;
+    std::deque<RetiredSet> retiredSets;     //Oldest first
+    std::unordered_map<VkDescriptorSetLayout, std::vector<VkDescriptorSet>> freeSets;
+    std::mutex mutex;
+    std::atomic<uint64_t> hits{ 0 };
+    std::atomic<uint64_t> misses{ 0 };
+    std::atomic<uint64_t> evictions{ 0 };
+    std::atomic<uint64_t> writes{ 0 };
+};
@@ -0,0 +1,32 @@
+#pragma once
+//SPIR-V compiled from VulkanTutorial/shaders at build time and linked into the executable, so creating
+//shader modules needs no file I/O and no working directory. The generated/ headers are written by
+//glslangValidator -V --vn (see the CustomBuild items in VulkanTutorial.vcxproj), each declaring a
+//constant-initialized uint32_t array that lives in read-only data, 4-byte aligned as Vulkan requires.
+
+#include <cstddef>
+#include <cstdint>
+
+#include "generated/shader_vert.h"
+#include "generated/shader_frag.h"
+#include "generated/shader_frag_bindless.h"
+#include "generated/shader_vert_instanced.h"
+#include "generated/shader_comp_cull.h"
+
+struct EmbeddedShader
+{
+    const char* sourceName;
+    const uint32_t* code;
+    size_t codeSize;        //In bytes, as VkShaderModuleCreateInfo wants
+};
+
+//Indexed by ShaderId
+constexpr EmbeddedShader embeddedShaders[] = {
+    { "shader.vert", shader_vert, sizeof(shader_vert) },
+    { "shader.frag", shader_frag, sizeof(shader_frag) },
+    { "shader_bindless.frag", shader_frag_bindless, sizeof(shader_frag_bindless) },
+    { "shader_instanced.vert", shader_vert_instanced, sizeof(shader_vert_instanced) },
+    { "shader_cull.comp", shader_comp_cull, sizeof(shader_comp_cull) }
+};
+
+constexpr size_t EMBEDDED_SHADER_COUNT = sizeof(embeddedShaders) / sizeof(embeddedShaders[0]);
@@ -0,0 +1,406 @@
+#pragma once
+//CPU frustum culling over bounding spheres and boxes. Volumes are stored structure-of-arrays, so a single SIMD
+//instruction tests one plane against several objects at once. The vector path is picked at compile time: AVX
+//(8 objects at a time) when building for it, SSE (4) on any x86-64, and a scalar fallback everywhere else.
+//Results are compact lists of visible indices in ascending order. Culling is conservative: volumes touching a
+//plane count as visible, and the paths can only disagree on volumes within rounding error of one.
+
+#include "thread_pool.h"
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <future>
+#include <vector>
+
+#if defined(__AVX__)
+#define FRUSTUM_CULLING_AVX
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FRUSTUM_CULLING_SSE
+#include <emmintrin.h>
+#endif
+
+#define FRUSTUM_PLANE_COUNT 6
+
+//Left, right, bottom, top, near, far. Each is (nx, ny, nz, d) with the normal pointing in, so a point p is
+//inside when dot(n, p) + d >= 0, and that's its distance from the plane.
+struct FrustumPlanes
+{
+    float planes[FRUSTUM_PLANE_COUNT][4];
+};
+
+//Gribb/Hartmann: each plane is a sum or difference of rows of the view-projection matrix. viewProj is column-major
+//(GLM's layout, so &viewProj[0][0]) with 0 to 1 depth, which makes near the third row alone. The planes come out
+//normalized, in whatever space the matrix transforms from (world space for proj * view).
+inline FrustumPlanes extractFrustumPlanes(const float* viewProj)
+{
+    float rows[4][4];
+    for(int row = 0; row < 4; row++)
+    {
+        for(int column = 0; column < 4; column++)
+            rows[row][column] = viewProj[column * 4 + row];
+    }
+
+    FrustumPlanes frustum;
+    for(int i = 0; i < 4; i++)
+    {
+        frustum.planes[0][i] = rows[3][i] + rows[0][i];
+        frustum.planes[1][i] = rows[3][i] - rows[0][i];
+        frustum.planes[2][i] = rows[3][i] + rows[1][i];
+        frustum.planes[3][i] = rows[3][i] - rows[1][i];
+        frustum.planes[4][i] = rows[2][i];
+        frustum.planes[5][i] = rows[3][i] - rows[2][i];
+    }
+    for(float* plane : frustum.planes)
+    {
+        float length = std::sqrt(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+        for(int i = 0; i < 4; i++)
+            plane[i] /= length;
+    }
+    return frustum;
+}
+
+inline const char* getFrustumCullingPath()
+{
+#if defined(FRUSTUM_CULLING_AVX)
+    return "AVX";
+#elif defined(FRUSTUM_CULLING_SSE)
+    return "SSE";
+#else
+    return "scalar";
+#endif
+}
+
+struct BoundingSpheres
+{
+    std::vector<float> centerX;
+    std::vector<float> centerY;
+    std::vector<float> centerZ;
+    std::vector<float> radius;
+
+    void add(float x, float y, float z, float sphereRadius)
+    {
+        centerX.push_back(x);
+        centerY.push_back(y);
+        centerZ.push_back(z);
+        radius.push_back(sphereRadius);
+    }
+
+    void reserve(size_t count)
+    {
+        centerX.reserve(count);
+        centerY.reserve(count);
+        centerZ.reserve(count);
+        radius.reserve(count);
+    }
+
+    void clear()
+    {
+        centerX.clear();
+        centerY.clear();
+        centerZ.clear();
+        radius.clear();
+    }
+
+    size_t size() const { return radius.size(); }
+};
+
+//Axis-aligned
+struct BoundingBoxes
+{
+    std::vector<float> minX;
+    std::vector<float> minY;
+    std::vector<float> minZ;
+    std::vector<float> maxX;
+    std::vector<float> maxY;
+    std::vector<float> maxZ;
+
+    void add(float x0, float y0, float z0, float x1, float y1, float z1)
+    {
+        minX.push_back(x0);
+        minY.push_back(y0);
+        minZ.push_back(z0);
+        maxX.push_back(x1);
+        maxY.push_back(y1);
+        maxZ.push_back(z1);
+    }
+
+    void reserve(size_t count)
+    {
+        minX.reserve(count);
+        minY.reserve(count);
+        minZ.reserve(count);
+        maxX.reserve(count);
+        maxY.reserve(count);
+        maxZ.reserve(count);
+    }
+
+    void clear()
+    {
+        minX.clear();
+        minY.clear();
+        minZ.clear();
+        maxX.clear();
+        maxY.clear();
+        maxZ.clear();
+    }
+
+    size_t size() const { return minX.size(); }
+};
+
+//Distance of a point from a plane. The vector kernels add in the same order.
+inline float planeDistance(const float* plane, float x, float y, float z)
+{
+    return (plane[0] * x + plane[1] * y) + (plane[2] * z + plane[3]);
+}
+
+inline bool isSphereVisible(const FrustumPlanes& frustum, float x, float y, float z, float radius)
+{
+    bool inside = true;
+    for(const float* plane : frustum.planes)
+        inside &= planeDistance(plane, x, y, z) >= -radius;
+    return inside;
+}
+
+//A box is outside a plane when even its corner furthest along the normal is
+inline bool isBoxVisible(const FrustumPlanes& frustum, float minX, float minY, float minZ, float maxX, float maxY, float maxZ)
+{
+    bool inside = true;
+    for(const float* plane : frustum.planes)
+        inside &= planeDistance(plane, plane[0] >= 0.0f ? maxX : minX, plane[1] >= 0.0f ? maxY : minY, plane[2] >= 0.0f ? maxZ : minZ) >= 0.0f;
+    return inside;
+}
+
+//Writes firstIndex + lane for each set bit of mask, in order, without branching on them. out needs room for laneCount
+//more past count even if fewer are visible.
+inline size_t appendVisibleLanes(uint32_t* out, size_t count, uint32_t firstIndex, int mask, int laneCount)
+{
+    for(int lane = 0; lane < laneCount; lane++)
+    {
+        out[count] = firstIndex + lane;
+        count += (mask >> lane) & 1;
+    }
+    return count;
+}
+
+//Appends the indices in [first, end) of the spheres inside the frustum to visible
+inline void cullSpheresScalar(const FrustumPlanes& frustum, const BoundingSpheres& spheres, size_t first, size_t end, std::vector<uint32_t>& visible)
+{
+    for(size_t i = first; i < end; i++)
+    {
+        if(isSphereVisible(frustum, spheres.centerX[i], spheres.centerY[i], spheres.centerZ[i], spheres.radius[i]))
+            visible.push_back((uint32_t)i);
+    }
+}
+
+inline void cullBoxesScalar(const FrustumPlanes& frustum, const BoundingBoxes& boxes, size_t first, size_t end, std::vector<uint32_t>& visible)
+{
+    for(size_t i = first; i < end; i++)
+    {
+        if(isBoxVisible(frustum, boxes.minX[i], boxes.minY[i], boxes.minZ[i], boxes.maxX[i], boxes.maxY[i], boxes.maxZ[i]))
+            visible.push_back((uint32_t)i);
+    }
+}
+
+//Same as cullSpheresScalar, several spheres at a time
+inline void cullSpheres(const FrustumPlanes& frustum, const BoundingSpheres& spheres, size_t first, size_t end, std::vector<uint32_t>& visible)
+{
+    //Sized for every sphere being visible, then trimmed
+    size_t count = visible.size();
+    visible.resize(count + (end - first));
+    uint32_t* out = visible.data();
+    size_t i = first;
+
+#if defined(FRUSTUM_CULLING_AVX)
+    __m256 planeX[FRUSTUM_PLANE_COUNT], planeY[FRUSTUM_PLANE_COUNT], planeZ[FRUSTUM_PLANE_COUNT], planeD[FRUSTUM_PLANE_COUNT];
+    for(int p = 0; p < FRUSTUM_PLANE_COUNT; p++)
+    {
+        planeX[p] = _mm256_set1_ps(frustum.planes[p][0]);
+        planeY[p] = _mm256_set1_ps(frustum.planes[p][1]);
+        planeZ[p] = _mm256_set1_ps(frustum.planes[p][2]);
+        planeD[p] = _mm256_set1_ps(frustum.planes[p][3]);
+    }
+
+    for(; i + 8 <= end; i += 8)
+    {
+        __m256 x = _mm256_loadu_ps(&spheres.centerX[i]);
+        __m256 y = _mm256_loadu_ps(&spheres.centerY[i]);
+        __m256 z = _mm256_loadu_ps(&spheres.centerZ[i]);
+        __m256 negRadius = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(&spheres.radius[i]));
+
+        __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for(int p = 0; p < FRUSTUM_PLANE_COUNT; p++)
+        {
+            __m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(planeX[p], x), _mm256_mul_ps(planeY[p], y)), _mm256_add_ps(_mm256_mul_ps(planeZ[p], z), planeD[p]));
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, negRadius, _CMP_GE_OQ));
+        }
+        count = appendVisibleLanes(out, count, (uint32_t)i, _mm256_movemask_ps(inside), 8);
+    }
+#elif defined(FRUSTUM_CULLING_SSE)
+    __m128 planeX[FRUSTUM_PLANE_COUNT], planeY[FRUSTUM_PLANE_COUNT], planeZ[FRUSTUM_PLANE_COUNT], planeD[FRUSTUM_PLANE_COUNT];
+    for(int p = 0; p < FRUSTUM_PLANE_COUNT; p++)
+    {
+        planeX[p] = _mm_set1_ps(frustum.planes[p][0]);
+        planeY[p] = _mm_set1_ps(frustum.planes[p][1]);
+        planeZ[p] = _mm_set1_ps(frustum.planes[p][2]);
+        planeD[p] = _mm_set1_ps(frustum.planes[p][3]);
+    }
+
+    for(; i + 4 <= end; i += 4)
+    {
+        __m128 x = _mm_loadu_ps(&spheres.centerX[i]);
+        __m128 y = _mm_loadu_ps(&spheres.centerY[i]);
+        __m128 z = _mm_loadu_ps(&spheres.centerZ[i]);
+        __m128 negRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(&spheres.radius[i]));
+
+        __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for(int p = 0; p < FRUSTUM_PLANE_COUNT; p++)
+        {
+            __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(planeX[p], x), _mm_mul_ps(planeY[p], y)), _mm_add_ps(_mm_mul_ps(planeZ[p], z), planeD[p]));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, negRadius));
+        }
+        count = appendVisibleLanes(out, count, (uint32_t)i, _mm_movemask_ps(inside), 4);
+    }
+#endif
+
+    for(; i < end; i++)
+    {
+        out[count] = (uint32_t)i;
+        count += isSphereVisible(frustum, spheres.centerX[i], spheres.centerY[i], spheres.centerZ[i], spheres.radius[i]) ? 1 : 0;
+    }
+    visible.resize(count);
+}
+
+//Same as cullBoxesScalar, several boxes at a time. Which corner each plane tests is picked once per plane, not per box.
+inline void cullBoxes(const FrustumPlanes& frustum, const BoundingBoxes& boxes, size_t first, size_t end, std::vector<uint32_t>& visible)
+{
+    size_t count = visible.size();
+    visible.resize(count + (end - first));
+    uint32_t* out = visible.data();
+    size_t i = first;
+
+#if defined(FRUSTUM_CULLING_AVX) || defined(FRUSTUM_CULLING_SSE)
+    //Per plane, whether the furthest corner along each axis is the max (true) or min
+    bool useMax[FRUSTUM_PLANE_COUNT][3];
+    for(int p = 0; p < FRUSTUM_PLANE_COUNT; p++)
+    {
+        for(int axis = 0; axis < 3; axis++)
+            useMax[p][axis] = frustum.planes[p][axis] >= 0.0f;
+    }
+#endif
+
+#if defined(FRUSTUM_CULLING_AVX)
+    for(; i + 8 <= end; i += 8)
+    {
+        __m256 minX = _mm256_loadu_ps(&boxes.minX[i]);
+        __m256 minY = _mm256_loadu_ps(&boxes.minY[i]);
+        __m256 minZ = _mm256_loadu_ps(&boxes.minZ[i]);
+        __m256 maxX = _mm256_loadu_ps(&boxes.maxX[i]);
+        __m256 maxY = _mm256_loadu_ps(&boxes.maxY[i]);
+        __m256 maxZ = _mm256_loadu_ps(&boxes.maxZ[i]);
+
+        __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for(int p = 0; p < FRUSTUM_PLANE_COUNT; p++)
+        {
+            const float* plane = frustum.planes[p];
+            __m256 x = useMax[p][0] ? maxX : minX;
+            __m256 y = useMax[p][1] ? maxY : minY;
+            __m256 z = useMax[p][2] ? maxZ : minZ;
+            __m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(plane[0]), x), _mm256_mul_ps(_mm256_set1_ps(plane[1]), y)),
+                _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(plane[2]), z), _mm256_set1_ps(plane[3])));
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, _mm256_setzero_ps(), _CMP_GE_OQ));
+        }
+        count = appendVisibleLanes(out, count, (uint32_t)i, _mm256_movemask_ps(inside), 8);
+    }
+#elif defined(FRUSTUM_CULLING_SSE)
+    for(; i + 4 <= end; i += 4)
+    {
+        __m128 minX = _mm_loadu_ps(&boxes.minX[i]);
+        __m128 minY = _mm_loadu_ps(&boxes.minY[i]);
+        __m128 minZ = _mm_loadu_ps(&boxes.minZ[i]);
+        __m128 maxX = _mm_loadu_ps(&boxes.maxX[i]);
+        __m128 maxY = _mm_loadu_ps(&boxes.maxY[i]);
+        __m128 maxZ = _mm_loadu_ps(&boxes.maxZ[i]);
+
+        __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for(int p = 0; p < FRUSTUM_PLANE_COUNT; p++)
+        {
+            const float* plane = frustum.planes[p];
+            __m128 x = useMax[p][0] ? maxX : minX;
+            __m128 y = useMax[p][1] ? maxY : minY;
+            __m128 z = useMax[p][2] ? maxZ : minZ;
+            __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane[0]), x), _mm_mul_ps(_mm_set1_ps(plane[1]), y)),
+                _mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane[2]), z), _mm_set1_ps(plane[3])));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, _mm_setzero_ps()));
+        }
+        count = appendVisibleLanes(out, count, (uint32_t)i, _mm_movemask_ps(inside), 4);
+    }
+#endif
+
+    for(; i < end; i++)
+    {
+        out[count] = (uint32_t)i;
+        count += isBoxVisible(frustum, boxes.minX[i], boxes.minY[i], boxes.minZ[i], boxes.maxX[i], boxes.maxY[i], boxes.maxZ[i]) ? 1 : 0;
+    }
+    visible.resize(count);
+}
+
+//Splits culling into contiguous chunks run on a thread pool, each into a list of its own, then joins the lists in
+//order, so the result is the same as culling everything in one go. The per-chunk visible lists and the list of
+//their futures are kept between calls, so those stop reallocating once they've grown; ThreadPool::submit() still
+//allocates a task per chunk. One instance shouldn't be used from several threads at once.
+class ParallelFrustumCuller
+{
+public:
+    //chunkCount of 1 culls on the calling thread
+    void cullSpheres(const FrustumPlanes& frustum, const BoundingSpheres& spheres, ThreadPool& threadPool, size_t chunkCount, std::vector<uint32_t>& visible)
+    {
+        cullChunks(spheres.size(), threadPool, chunkCount, visible, [&frustum, &spheres](size_t first, size_t end, std::vector<uint32_t>& chunkVisible)
+        {
+            ::cullSpheres(frustum, spheres, first, end, chunkVisible);
+        });
+    }
+
+    void cullBoxes(const FrustumPlanes& frustum, const BoundingBoxes& boxes, ThreadPool& threadPool, size_t chunkCount, std::vector<uint32_t>& visible)
+    {
+        cullChunks(boxes.size(), threadPool, chunkCount, visible, [&frustum, &boxes](size_t first, size_t end, std::vector<uint32_t>& chunkVisible)
+        {
+            ::cullBoxes(frustum, boxes, first, end, chunkVisible);
+        });
+    }
+
+private:
+    template<typename CullRange>
+    void cullChunks(size_t objectCount, ThreadPool& threadPool, size_t chunkCount, std::vector<uint32_t>& visible, CullRange cullRange)
+    {
+        visible.clear();
+        if(chunkCount <= 1)
+        {
+            cullRange(0, objectCount, visible);
+            return;
+        }
+
+        if(chunkVisible.size() < chunkCount)
+            chunkVisible.resize(chunkCount);
+        chunks.clear();
+        for(size_t chunk = 0; chunk < chunkCount; chunk++)
+        {
+            size_t first = objectCount * chunk / chunkCount;
+            size_t end = objectCount * (chunk + 1) / chunkCount;
+            std::vector<uint32_t>* list = &chunkVisible[chunk];
+            list->clear();
+            chunks.push_back(threadPool.submit([cullRange, first, end, list]() { cullRange(first, end, *list); }));
+        }
+        for(std::future<void>& chunk : chunks)
+            chunk.wait();
+
+        chunks.clear();
+
+        for(size_t chunk = 0; chunk < chunkCount; chunk++)
+            visible.insert(visible.end(), chunkVisible[chunk].begin(), chunkVisible[chunk].end());
+    }
+
+    std::vector<std::vector<uint32_t>> chunkVisible;
+    std::vector<std::future<void>> chunks;     //Only in use during cullChunks()
+};
@@ -0,0 +1,44 @@
+#pragma once
+//FNV-1a hashing for the caches' keys. Fast and simple; keys are made of handles, enums and small counts, which
+//don't need anything stronger.
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#define FNV1A_OFFSET_BASIS 14695981039346656037ULL
+#define FNV1A_PRIME 1099511628211ULL
+
+//One step per 64 bit word, for keys that are packed into words already
+inline uint64_t fnv1aWords(const uint64_t* words, size_t count)
+{
+    uint64_t hash = FNV1A_OFFSET_BASIS;
+    for(size_t i = 0; i < count; i++)
+    {
+        hash ^= words[i];
+        hash *= FNV1A_PRIME;
+    }
+    return hash;
+}
+
+//One step per byte, for plain structs. Padding is hashed too, so it must be zeroed
+inline uint64_t fnv1aBytes(const void* data, size_t size)
+{
+    const uint8_t* bytes = (const uint8_t*)data;
+    uint64_t hash = FNV1A_OFFSET_BASIS;
+    for(size_t i = 0; i < size; i++)
+    {
+        hash ^= bytes[i];
+        hash *= FNV1A_PRIME;
+    }
+    return hash;
+}
+
+//Hash for unordered_maps keyed by a vector of words
+struct WordKeyHash
+{
+    size_t operator()(const std::vector<uint64_t>& key) const
+    {
+        return (size_t)fnv1aWords(key.data(), key.size());
+    }
+};
@@ -0,0 +1,294 @@
+#pragma once
+//Deduplicating cache of descriptor set layouts and pipeline layouts, built from reflected shader interfaces.
+//Shaders that declare the same bindings get the same VkDescriptorSetLayout, and pipelines whose sets and
+//push constants match share a VkPipelineLayout, which keeps their descriptor sets compatible.
+//Samplers registered with setImmutableSamplers() are baked into the layouts of their bindings.
+//Safe to call from any thread, once setUnsizedArrayCapacity(), setImmutableSamplers() and setPushDescriptorSet() (if needed) have been called.
+
+#include <vulkan/vulkan.h>
+#include "hash.h"
+#include "spirv_reflection.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+class LayoutCache
+{
+public:
+    //Runtime-sized arrays (descriptorCount 0 in the reflection) become variable-count bindings of up to this many
+    //descriptors. Sets that have one are bindless: every binding in them is partially bound and update-after-bind,
+    //so they need VK_EXT_descriptor_indexing and a pool created with VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT_EXT.
+    //Leave at 0 if the device doesn't support that; layouts with unsized arrays then fail.
+    void setUnsizedArrayCapacity(uint32_t capacity)
+    {
+        unsizedArrayCapacity = capacity;
+    }
+
+    uint32_t getUnsizedArrayCapacity() const
+    {
+        return unsizedArrayCapacity;
+    }
+
+    //Bakes samplers into every layout with a sampler or combined image sampler at this set and binding, so
+    //descriptor writes for it can leave the sampler out. There must be one per array element; layouts where
+    //the count doesn't match fail. The samplers must outlive the layouts.
+    void setImmutableSamplers(uint32_t set, uint32_t binding, const std::vector<VkSampler>& samplers)
+    {
+        immutableSamplers[((uint64_t)set << 32) | binding] = samplers;
+    }
+
+    //Layouts for this set number are made for vkCmdPushDescriptorSetKHR instead of allocated sets (needs
+    //VK_KHR_push_descriptor). Only one set of a pipeline layout can be pushed, and not a bindless or dynamic one.
+    //UINT32_MAX for none.
+    void setPushDescriptorSet(uint32_t set)
+    {
+        pushDescriptorSet = set;
+    }
+
+    uint32_t getPushDescriptorSet() const
+    {
+        return pushDescriptorSet;
+    }
+
+    static bool hasUnsizedArray(const ShaderReflection& reflection, uint32_t set)
+    {
+        for(const ReflectedBinding& binding : reflection.bindings)
+        {
+            if(binding.set == set && binding.descriptorCount == 0)
+                return true;
+        }
+        return false;
+    }
+
+    //Layout for one descriptor set number of the interface (empty if the shaders don't use that set).
+    //Returns VK_NULL_HANDLE on failure.
+    VkDescriptorSetLayout getDescriptorSetLayout(VkDevice device, const ShaderReflection& reflection, uint32_t set)
+    {
+        std::vector<VkDescriptorSetLayoutBinding> bindings;
+        std::vector<VkDescriptorBindingFlagsEXT> bindingFlags;
+        LayoutKey key;
+        if(!buildSetLayout(reflection, set, bindings, bindingFlags, key))
+            return VK_NULL_HANDLE;
+        bool bindless = hasUnsizedArray(reflection, set);
+        bool push = (set == pushDescriptorSet);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        auto found = setLayouts.find(key);
+        if(found != setLayouts.end())
+            return found->second;
+
+        VkDescriptorSetLayoutBindingFlagsCreateInfoEXT bindingFlagsInfo = {};
+        bindingFlagsInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO_EXT;
+        bindingFlagsInfo.bindingCount = static_cast<uint32_t>(bindingFlags.size());
+        bindingFlagsInfo.pBindingFlags = bindingFlags.data();
+
+        VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+        layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        layoutInfo.pNext = bindless ? &bindingFlagsInfo : NULL;
+        layoutInfo.flags = bindless ? VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT_EXT : 0;
+        if(push)
+            layoutInfo.flags |= VK_DESCRIPTOR_SET_LAYOUT_CREATE_PUSH_DESCRIPTOR_BIT_KHR;
+        layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+        layoutInfo.pBindings = bindings.data();
+
+        VkDescriptorSetLayout setLayout;
+        if(vkCreateDescriptorSetLayout(device, &layoutInfo, NULL, &setLayout) != VK_SUCCESS)
+            return VK_NULL_HANDLE;
+        setLayouts.emplace(key, setLayout);
+        return setLayout;
+    }
+
+    //Pipeline layout covering every set the interface uses, plus its push constant block.
+    //Returns VK_NULL_HANDLE on failure.
+    VkPipelineLayout getPipelineLayout(VkDevice device, const ShaderReflection& reflection)
+    {
+        uint32_t setCount = getSetCount(reflection);
+        std::vector<VkDescriptorSetLayout> descriptorSetLayouts(setCount);
+        for(uint32_t set = 0; set < setCount; set++)
+        {
+            descriptorSetLayouts[set] = getDescriptorSetLayout(device, reflection, set);
+            if(descriptorSetLayouts[set] == VK_NULL_HANDLE)
+                return VK_NULL_HANDLE;
+        }
+
+        VkPushConstantRange pushConstantRange = {};
+        pushConstantRange.stageFlags = reflection.pushConstantStageFlags;
+        pushConstantRange.offset = 0;
+        pushConstantRange.size = reflection.pushConstantSize;
+
+        //Set layouts are already deduplicated, so their handles identify them
+        LayoutKey key;
+        for(VkDescriptorSetLayout setLayout : descriptorSetLayouts)
+        {
+            uint64_t handle = 0;
+            memcpy(&handle, &setLayout, sizeof(setLayout));
+            key.push_back(handle);
+        }
+        key.push_back(pushConstantRange.stageFlags);
+        key.push_back(pushConstantRange.size);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        auto found = pipelineLayouts.find(key);
+        if(found != pipelineLayouts.end())
+            return found->second;
+
+        VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+        pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipelineLayoutInfo.setLayoutCount = setCount;
+        pipelineLayoutInfo.pSetLayouts = descriptorSetLayouts.data();
+        pipelineLayoutInfo.pushConstantRangeCount = (pushConstantRange.size > 0) ? 1 : 0;
+        pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+        VkPipelineLayout pipelineLayout;
+        if(vkCreatePipelineLayout(device, &pipelineLayoutInfo, NULL, &pipelineLayout) != VK_SUCCESS)
+            return VK_NULL_HANDLE;
+        pipelineLayouts.emplace(key, pipelineLayout);
+        return pipelineLayout;
+    }
+
+    //Whether the two interfaces would get the same pipeline layout, making pipelines built from them compatible.
+    //Only compares layout keys, so unlike getPipelineLayout() nothing is created or cached. False if either fails.
+    bool matches(const ShaderReflection& a, const ShaderReflection& b)
+    {
+        if(a.pushConstantStageFlags != b.pushConstantStageFlags || a.pushConstantSize != b.pushConstantSize)
+            return false;
+        uint32_t setCount = getSetCount(a);
+        if(getSetCount(b) != setCount)
+            return false;
+
+        std::vector<VkDescriptorSetLayoutBinding> bindings;
+        std::vector<VkDescriptorBindingFlagsEXT> bindingFlags;
+        LayoutKey keyA, keyB;
+        for(uint32_t set = 0; set < setCount; set++)
+        {
+            if(!buildSetLayout(a, set, bindings, bindingFlags, keyA) || !buildSetLayout(b, set, bindings, bindingFlags, keyB) || keyA != keyB)
+                return false;
+        }
+        return true;
+    }
+
+    size_t getDescriptorSetLayoutCount()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return setLayouts.size();
+    }
+
+    size_t getPipelineLayoutCount()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return pipelineLayouts.size();
+    }
+
+    //Only once nothing built from these layouts is in use
+    void destroyAll(VkDevice device)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for(auto& entry : pipelineLayouts)
+            vkDestroyPipelineLayout(device, entry.second, NULL);
+        for(auto& entry : setLayouts)
+            vkDestroyDescriptorSetLayout(device, entry.second, NULL);
+        pipelineLayouts.clear();
+        setLayouts.clear();
+    }
+
+private:
+    typedef std::vector<uint64_t> LayoutKey;
+
+    //Highest set number the interface uses, plus one
+    static uint32_t getSetCount(const ShaderReflection& reflection)
+    {
+        uint32_t setCount = 0;
+        for(const ReflectedBinding& binding : reflection.bindings)
+            setCount = std::max(setCount, binding.set + 1);
+        return setCount;
+    }
+
+    //Bindings, their flags, and the key identifying the layout for one set number, without creating anything.
+    //Returns false if the set can't be made into a layout.
+    bool buildSetLayout(const ShaderReflection& reflection, uint32_t set, std::vector<VkDescriptorSetLayoutBinding>& bindings, std::vector<VkDescriptorBindingFlagsEXT>& bindingFlags, LayoutKey& key)
+    {
+        bool bindless = hasUnsizedArray(reflection, set);
+        if(bindless && unsizedArrayCapacity == 0)
+            return false;
+        bool push = (set == pushDescriptorSet);
+        if(push && bindless)
+            return false;
+
+        bindings.clear();
+        bindingFlags.clear();
+        for(const ReflectedBinding& reflected : reflection.bindings)
+        {
+            if(reflected.set != set)
+                continue;
+
+            VkDescriptorSetLayoutBinding binding = {};
+            binding.binding = reflected.binding;
+            binding.descriptorType = reflected.descriptorType;
+            binding.descriptorCount = (reflected.descriptorCount != 0) ? reflected.descriptorCount : unsizedArrayCapacity;
+            binding.stageFlags = reflected.stageFlags;
+            binding.pImmutableSamplers = NULL;
+            if(push && (reflected.descriptorType == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC || reflected.descriptorType == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC))
+                return false;
+            if(reflected.descriptorType == VK_DESCRIPTOR_TYPE_SAMPLER || reflected.descriptorType == VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER)
+            {
+                auto immutable = immutableSamplers.find(((uint64_t)set << 32) | reflected.binding);
+                if(immutable != immutableSamplers.end())
+                {
+                    if(immutable->second.size() != binding.descriptorCount)
+                        return false;
+                    binding.pImmutableSamplers = immutable->second.data();
+                }
+            }
+            bindings.push_back(binding);
+
+            VkDescriptorBindingFlagsEXT flags = 0;
+            if(bindless)
+                flags = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT_EXT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT_EXT | VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT_EXT;
+            if(reflected.descriptorCount == 0)
+                flags |= VK_DESCRIPTOR_BINDING_VARIABLE_DESCRIPTOR_COUNT_BIT_EXT;
+            bindingFlags.push_back(flags);
+        }
+
+        //Only the highest-numbered binding may have a variable count
+        if(bindless && !(bindingFlags.back() & VK_DESCRIPTOR_BINDING_VARIABLE_DESCRIPTOR_COUNT_BIT_EXT))
+            return false;
+        for(size_t i = 0; i + 1 < bindingFlags.size(); i++)
+        {
+            if(bindingFlags[i] & VK_DESCRIPTOR_BINDING_VARIABLE_DESCRIPTOR_COUNT_BIT_EXT)
+                return false;
+        }
+
+        key.clear();
+        key.push_back(push ? 1 : 0);
+        for(size_t i = 0; i < bindings.size(); i++)
+        {
+            key.push_back(bindings[i].binding);
+            key.push_back(bindings[i].descriptorType);
+            key.push_back(bindings[i].descriptorCount);
+            key.push_back(bindings[i].stageFlags);
+            key.push_back(bindingFlags[i]);
+            key.push_back((bindings[i].pImmutableSamplers != NULL) ? 1 : 0);
+            if(bindings[i].pImmutableSamplers != NULL)
+            {
+                for(uint32_t j = 0; j < bindings[i].descriptorCount; j++)
+                {
+                    uint64_t handle = 0;
+                    memcpy(&handle, &bindings[i].pImmutableSamplers[j], sizeof(VkSampler));
+                    key.push_back(handle);
+                }
+            }
+        }
+        return true;
+    }
+
+    std::unordered_map<LayoutKey, VkDescriptorSetLayout, WordKeyHash> setLayouts;
+    std::unordered_map<LayoutKey, VkPipelineLayout, WordKeyHash> pipelineLayouts;
+    std::mutex mutex;
+    uint32_t unsizedArrayCapacity = 0;
+    uint32_t pushDescriptorSet = UINT32_MAX;
+    std::unordered_map<uint64_t, std::vector<VkSampler>> immutableSamplers;     //Set number in the high 32 bits, binding in the low
+};
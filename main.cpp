@@ -7,6 +7,17 @@
 #include <glm/gtc/matrix_transform.hpp>
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
+#include "png16.h"
+#include "texture_conversion.h"
+#include "pipeline_registry.h"
+#include "thread_pool.h"
+#include "frustum_culling.h"
+#include "shader_watcher.h"
+#include "embedded_shaders.h"
+#include "layout_cache.h"
+#include "descriptor_allocator.h"
+#include "descriptor_set_cache.h"
+#include "sampler_cache.h"
 
 #include <iostream>
 #include <stdexcept>
@@ -18,11 +29,22 @@
 #include <algorithm>
 #include <fstream>
 #include <array>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>    //MoveFileExA, for replacing the pipeline cache file
+#endif
 
 //Application-specific defines
 #define WIDTH 800
 #define HEIGHT 600
 #define APPLICATION_NAME "Vulkan SDL"
+#define TEXTURE_PATH "textures/texture.jpg"
 
 #define MAJOR_VERSION 1
 #define MINOR_VERSION 0
@@ -31,6 +53,28 @@
 //Vulkan-specific defines
 #define VULKAN_API_VERSION VK_API_VERSION_1_1
 #define QUEUE_PRIORITY 1.0f
+#define MAX_FRAMES_IN_FLIGHT 2
+#define SHADER_DIRECTORY "shaders/"
+#define DESCRIPTOR_POOL_INITIAL_SETS 16  //Pools double from here as they fill up
+#define MAX_SCENE_OBJECTS 32768         //Capacity of objectUniformBuffer
+#define MAX_INSTANCES 100000            //Capacity of instanceBuffer
+#define INSTANCE_FIRST_LOCATION 3       //Instanced vertex shader inputs from this location on are per instance (InstanceData)
+#define INSTANCE_BENCHMARK_FRAMES 300   //Timed frames per instance count, after a few warm-up frames
+#define CULL_WORKGROUP_SIZE 64          //local_size_x of shader_cull.comp
+#define RECORD_MIN_OBJECTS_PER_CHUNK 256    //Below this many draws per thread, recording inline on one thread is quicker
+#define CULL_MIN_OBJECTS_PER_CHUNK 4096     //Below this many objects per thread, culling them on one thread is quicker
+#define RECORD_BENCHMARK_OBJECTS 16384  //Scene objects --record-benchmark uses unless --objects asks for more
+#define RECORD_BENCHMARK_ITERATIONS 50  //Timed recordings per thread count, after a couple of warm-up ones
+#define DESCRIPTOR_SET_CACHE_CAPACITY 1024  //Should cover every set a frame draws with, or they'll keep evicting each other
+#define MAX_BINDLESS_TEXTURES 4096      //Upper bound on the bindless texture array; also limited by the device
+#define BINDLESS_SAMPLER_BINDING 0      //In the material set of shader_bindless.frag
+#define BINDLESS_TEXTURE_BINDING 1
+#define BINDLESS_TEXTURE_INDEX_BITS 24  //Bindless material ID: texture index in the low bits, sampler index above
+#define PIPELINE_LIBRARY_PART_COUNT 4   //Vertex input, pre-rasterization, fragment shader, fragment output; in VkGraphicsPipelineLibraryFlagBitsEXT bit order
+#define PIPELINE_CACHE_PATH "pipeline_cache.bin"
+#define PIPELINE_CACHE_MAGIC 0x43505456  //"VTPC"
+#define PIPELINE_USAGE_LOG_PATH "pipeline_usage.bin"
+#define PIPELINE_USAGE_LOG_MAGIC 0x55505456  //"VTPU"
 
 struct QueueFamilyIndices
 {
@@ -50,52 +94,161 @@ struct SwapChainSupportDetails
     std::vector<VkPresentModeKHR> presentModes;
 };
 
+//Prepended to the VkPipelineCache blob on disk. The driver validates its own header too, but it doesn't
+//check the driver version, and a driver update can leave it happily loading stale data.
+struct PipelineCacheFileHeader
+{
+    uint32_t magic;
+    uint32_t headerSize;
+    uint32_t vendorID;
+    uint32_t deviceID;
+    uint32_t driverVersion;
+    uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+    uint64_t dataSize;
+};
+
+//Pipeline usage log: this header followed by descriptionCount raw PipelineDescriptions
+struct PipelineUsageLogHeader
+{
+    uint32_t magic;
+    uint32_t descriptionSize;
+    uint32_t descriptionCount;
+};
+
+//Tightly packed in the vertex shader's input location order; pipeline vertex input is reflected from the shader
 struct Vertex
 {
     glm::vec3 pos;
     glm::vec3 color;
     glm::vec2 texCoord;
+};
 
-    static VkVertexInputBindingDescription getBindingDescription()
-    {
-        VkVertexInputBindingDescription bindingDescription = {};
-        bindingDescription.binding = 0;
-        bindingDescription.stride = sizeof(Vertex);
-        bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+//Per-instance vertex stream of shader_instanced.vert, tightly packed in its input location order from INSTANCE_FIRST_LOCATION
+struct InstanceData
+{
+    glm::mat4 model;
+    glm::vec4 color;            //Multiplies the vertex color
+};
 
-        return bindingDescription;
-    }
+//From the command line
+struct AppOptions
+{
+    uint32_t instanceCount = 0;         //Copies of the mesh drawn with one instanced draw; 0 for none
+    bool instanceBenchmark = false;     //Time frames at increasing instance counts, then exit
+    bool gpuCulling = false;            //Frustum cull instances in a compute pass and draw the visible ones indirectly
+    uint32_t objectCount = 1;           //Scene objects, each its own draw call; more than one are laid out like the instance grid
+    bool recordBenchmark = false;       //Time command buffer recording across increasing thread counts, then exit
+    bool perFrameRecording = false;     //Re-record every frame from transient pools, instead of once per swapchain image
+};
 
-    static std::array<VkVertexInputAttributeDescription, 3> getAttributeDescriptions()
-    {
-        std::array<VkVertexInputAttributeDescription, 3> attributeDescriptions = {};
+//Per-frame data
+struct UniformBufferObject
+{
+    glm::mat4 view;
+    glm::mat4 proj;
+    glm::vec4 frustumPlanes[6];         //World space, normals pointing in; only the cull shader reads them
+};
 
-        attributeDescriptions[0].binding = 0;
-        attributeDescriptions[0].location = 0;
-        attributeDescriptions[0].format = VK_FORMAT_R32G32B32_SFLOAT;
-        attributeDescriptions[0].offset = offsetof(Vertex, pos);
+//What the cull shader writes into an object's indirect draw if it's visible. Must match DrawRecord in shader_cull.comp.
+struct CullDrawRecord
+{
+    uint32_t indexCount;
+    uint32_t firstIndex;
+    int32_t vertexOffset;
+    uint32_t padding;
+};
+static_assert(sizeof(CullDrawRecord) == 16, "CullDrawRecord must match the std430 layout in shader_cull.comp");
 
-        attributeDescriptions[1].binding = 0;
-        attributeDescriptions[1].location = 1;
-        attributeDescriptions[1].format = VK_FORMAT_R32G32B32_SFLOAT;
-        attributeDescriptions[1].offset = offsetof(Vertex, color);
+//Per-object data. Every object's copy is packed into objectUniformBuffer, each at a multiple of
+//minUniformBufferOffsetAlignment, and draws select theirs with a dynamic offset into the same descriptor set.
+struct ObjectUniforms
+{
+    glm::mat4 model;
+};
 
-        attributeDescriptions[2].binding = 0;
-        attributeDescriptions[2].location = 2;
-        attributeDescriptions[2].format = VK_FORMAT_R32G32_SFLOAT;
-        attributeDescriptions[2].offset = offsetof(Vertex, texCoord);
+//Small per-draw values, pushed while recording
+struct ObjectPushConstants
+{
+    uint32_t objectId;
+    uint32_t materialId;        //Bindless only; filled in from Material::bindlessId while recording
+};
 
-        return attributeDescriptions;
-    }
+//What a material's descriptor set is written with. The set itself is looked up in descriptorSetCache while recording.
+struct Material
+{
+    VkImageView imageView;
+    uint32_t sampler;           //CommonSampler
+    uint32_t bindlessId;        //Bindless only: texture and sampler indices, as shader_bindless.frag unpacks them
 };
 
-struct UniformBufferObject
+struct SceneObject
 {
-    glm::mat4 model;
-    glm::mat4 view;
-    glm::mat4 proj;
+    ObjectUniforms uniforms;    //Copied to objectUniformBuffer at the object's index in sceneObjects
+    ObjectPushConstants constants;
+    uint32_t material;          //Index into materials
+};
+
+//Sampler states materials can use. They're immutable samplers in the material set layout: the bindless sampler
+//table holds all of them, in this order; the non-bindless combined image sampler is SAMPLER_LINEAR_REPEAT.
+enum CommonSampler
+{
+    SAMPLER_LINEAR_REPEAT = 0,
+    SAMPLER_LINEAR_CLAMP,
+    SAMPLER_NEAREST_REPEAT,         //For pixelly images
+    SAMPLER_NEAREST_CLAMP,
+    COMMON_SAMPLER_COUNT
+};
+static_assert(COMMON_SAMPLER_COUNT <= (1u << (32 - BINDLESS_TEXTURE_INDEX_BITS)), "CommonSampler doesn't fit in a bindless material ID");
+
+//Shaders group descriptors into sets by how often they change, so switching material only rebinds set 1.
+//Frame and material sets are looked up by contents in descriptorSetCache, so identical ones are only written once;
+//with VK_KHR_push_descriptor the material set is pushed while recording instead.
+//With per-frame recording the frame set is transient instead, allocated each frame from transientSetAllocators and
+//only lasting until its frame slot comes round again. With bindless textures there is a single material set holding
+//every texture, bound once, and draws pick their material by ID instead.
+enum DescriptorSetFrequency
+{
+    DESCRIPTOR_SET_FRAME = 0,       //Camera and other per-frame uniforms
+    DESCRIPTOR_SET_MATERIAL,        //Textures
+    DESCRIPTOR_SET_DRAW,            //Per-object uniforms. One set, rebound per draw with a different dynamic offset
+    DESCRIPTOR_SET_COUNT
+};
+
+//IDs stored in PipelineDescription, so only ever append to this list. Indexes embeddedShaders.
+enum ShaderId
+{
+    SHADER_VERT = 0,
+    SHADER_FRAG,
+    SHADER_FRAG_BINDLESS,
+    SHADER_VERT_INSTANCED,
+    SHADER_COMP_CULL,
+    SHADER_COUNT
+};
+static_assert(SHADER_COUNT == EMBEDDED_SHADER_COUNT, "Every ShaderId needs an entry in embeddedShaders");
+
+//Hot reload only. Relative to SHADER_DIRECTORY
+const char* const shaderFileNames[SHADER_COUNT] = {
+    "vert.spv",
+    "frag.spv",
+    "frag_bindless.spv",
+    "vert_instanced.spv",
+    "comp_cull.spv"             //Watched, but the cull pipeline isn't rebuilt; picked up on the next restart
+};
+
+//Optional shader code paths, chosen per pipeline with specialization constants. Bit index is the
+//constant_id in the shaders, so only ever append to this list.
+enum ShaderFeature
+{
+    SHADER_FEATURE_TEXTURED = 1 << 0,
+    SHADER_FEATURE_VERTEX_COLOR = 1 << 1,
+    SHADER_FEATURE_ALPHA_TEST = 1 << 2,
+    SHADER_FEATURE_FOG = 1 << 3,
+    SHADER_FEATURE_COUNT = 4
 };
 
+//SPIR-V loaded from disk by hot reload, replacing the embedded code. NULL entries use embeddedShaders.
+typedef std::array<std::shared_ptr<const std::vector<uint32_t>>, SHADER_COUNT> ShaderOverrides;
+
 const std::vector<const char*> deviceExtensions = {
     VK_KHR_SWAPCHAIN_EXTENSION_NAME
 };
@@ -161,6 +314,7 @@ private:
 #endif
     VkInstance instance;
     VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;   //Implicitly destroyed when VkInstance is
+    float maxSamplerAnisotropy = 1.0f;                  //physicalDevice's limit, read when it's picked
     VkDevice device;
     VkQueue graphicsQueue;
     VkSurfaceKHR surface;
@@ -173,37 +327,111 @@ private:
     VkPipelineLayout pipelineLayout;
     VkRenderPass renderPass;
     VkPipeline graphicsPipeline;
+    VkPipeline instancedPipeline = VK_NULL_HANDLE;  //Only when instancing is in use (isInstancingEnabled())
+    PipelineRegistry pipelineRegistry;
+    PipelineRegistry pipelineLibraryParts[PIPELINE_LIBRARY_PART_COUNT];    //Only with graphicsPipelineLibrarySupported
+    ThreadPool pipelineCompilePool;     //Declared after the registries so queued compiles finish before they go away
+    ThreadPool recordPool;              //Records chunks of large scenes into secondary command buffers in parallel
+    bool graphicsPipelineLibrarySupported = false;
+    bool bindlessTexturesSupported = false;
+    uint32_t bindlessTextureCapacity = 0;
+    bool pushDescriptorsSupported = false;      //Material textures are pushed while recording instead of bound as sets
+    PFN_vkCmdPushDescriptorSetKHR cmdPushDescriptorSet = NULL;
+    bool drawIndirectCountSupported = false;    //GPU culling packs visible draws and the GPU reads back how many there are
+    PFN_vkCmdDrawIndexedIndirectCountKHR cmdDrawIndexedIndirectCount = NULL;
+    std::vector<std::pair<PipelineDescription, std::shared_future<VkPipeline>>> pendingOptimizedPipelines;  //Guarded by optimizedPipelinesMutex
+    std::mutex optimizedPipelinesMutex;
+    std::vector<std::shared_future<VkPipeline>> pendingPipelines;
+    std::chrono::high_resolution_clock::time_point pipelineCompileStartTime;
+    VkPipelineCache pipelineCache;
+    bool pipelineCacheLoaded = false;
     std::vector<VkFramebuffer> swapChainFramebuffers;
     VkCommandPool commandPool;
-    std::vector<VkCommandBuffer> commandBuffers;
-    VkSemaphore imageAvailableSemaphore;
-    VkSemaphore renderFinishedSemaphore;
+    std::vector<VkCommandBuffer> commandBuffers;    //Per swapchain image, or with options.perFrameRecording per frame in flight
+    std::vector<VkCommandPool> frameCommandPools;   //With options.perFrameRecording, the pool of each of commandBuffers
+    std::vector<bool> commandBufferDirty;       //Re-record before the next submit. Not used with options.perFrameRecording.
+    std::vector<std::vector<VkCommandPool>> secondaryCommandPools;      //Per commandBuffers entry, one per recordPool thread; each only ever used by one chunk at a time
+    std::vector<std::vector<VkCommandBuffer>> secondaryCommandBuffers;  //The one buffer in each of secondaryCommandPools
+    std::vector<VkSemaphore> imageAvailableSemaphores;
+    std::vector<VkSemaphore> renderFinishedSemaphores;
+    std::vector<VkFence> inFlightFences;
+    std::vector<VkFence> imagesInFlight;        //Fence of the frame currently using each swapchain image
+    size_t currentFrame = 0;
+    uint64_t frameNumber = 0;
+    std::vector<std::pair<uint64_t, std::function<void()>>> deletionQueue;  //Frame number it's safe to run at, destroy function
+    ShaderWatcher shaderWatcher;
+    std::vector<std::pair<PipelineDescription, std::shared_future<VkPipeline>>> pendingReloads;
+    ShaderOverrides pendingShaderOverrides;     //What pendingReloads are being built with
+    ShaderOverrides shaderOverrides;            //Guarded by shaderOverridesMutex; read by pipeline builds on worker threads
+    std::mutex shaderOverridesMutex;
     VkBuffer combinedBuffer;
     VkDeviceMemory combinedBufferMemory;
     VkBuffer uniformBuffer;
     VkDeviceMemory uniformBufferMemory;
-    VkDescriptorSetLayout descriptorSetLayout;
-    VkDescriptorPool descriptorPool;
-    VkDescriptorSet descriptorSet;
+    VkDescriptorSetLayout frameSetLayout;
+    VkDescriptorSetLayout materialSetLayout;
+    VkDescriptorSetLayout drawSetLayout;
+    VkBuffer objectUniformBuffer;
+    VkDeviceMemory objectUniformBufferMemory;
+    void* objectUniformData;                    //Persistently mapped
+    VkDeviceSize objectUniformStride;           //sizeof(ObjectUniforms) rounded up to minUniformBufferOffsetAlignment
+    AppOptions options;
+    VkBuffer instanceBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory instanceBufferMemory;
+    uint32_t instanceCount = 0;
+    ShaderReflection cullInterface;             //Only with options.gpuCulling, as are the rest of the cull members
+    VkDescriptorSetLayout cullSetLayout;
+    VkPipelineLayout cullPipelineLayout;
+    VkPipeline cullPipeline = VK_NULL_HANDLE;
+    VkBuffer objectBoundsBuffer;                //Bounding sphere per instance, world space
+    VkDeviceMemory objectBoundsBufferMemory;
+    VkBuffer drawRecordBuffer;                  //CullDrawRecord per instance
+    VkDeviceMemory drawRecordBufferMemory;
+    VkBuffer drawCommandBuffer;                 //VkDrawIndexedIndirectCommand per instance, written by the cull pass
+    VkDeviceMemory drawCommandBufferMemory;
+    VkBuffer drawCountBuffer;                   //Visible draws in drawCommandBuffer, with drawIndirectCountSupported
+    VkDeviceMemory drawCountBufferMemory;
+    LayoutCache layoutCache;
+    std::vector<SceneObject> sceneObjects;      //Sorted by material
+    BoundingSpheres sceneObjectBounds;          //World space, one per sceneObjects entry, in the same order
+    std::vector<uint32_t> visibleObjects;       //sceneObjects indices to draw, ascending. All of them unless culled per frame.
+    ParallelFrustumCuller sceneCuller;
+    FrustumPlanes cameraFrustum = {};           //As of the last updateUniformBuffer(). All zero before it, which culls nothing.
+    ShaderReflection shaderInterface;           //Of the default shaders; what the set layouts, pipelineLayout and descriptor pools are built from
+    DescriptorSetCache descriptorSetCache;
+    uint64_t recordedCacheEvictions = 0;        //descriptorSetCache evictions the command buffers have been recorded after
+    DescriptorAllocator bindlessSetAllocator;
+    DescriptorAllocator transientSetAllocators[MAX_FRAMES_IN_FLIGHT];   //Reset when their frame's fence signals
+    VkDescriptorSet bindlessMaterialSet = VK_NULL_HANDLE;
+    std::vector<Material> materials;
+    SamplerCache samplerCache;
+    VkSampler commonSamplers[COMMON_SAMPLER_COUNT];
+    uint32_t bindlessTextureCount = 0;
     uint32_t textureMipLevels;
+    VkFormat textureFormat;
     VkImage textureImage;
     VkDeviceMemory textureImageMemory;
     VkImageView textureImageView;
-    VkSampler textureSampler;
     VkImage depthImage;
     VkDeviceMemory depthImageMemory;
     VkImageView depthImageView;
 
 public:
     //Public member functions
-    void run()
+    void run(const AppOptions& appOptions)
     {
 #ifdef PAUSE_HACK
         atexit(pause);
 #endif
+        options = appOptions;
         initWindow();
         initVulkan();
-        mainLoop();
+        if(options.instanceBenchmark)
+            runInstanceBenchmark();
+        else if(options.recordBenchmark)
+            runRecordBenchmark();
+        else
+            mainLoop();
         cleanup();
     }
 
@@ -241,23 +469,31 @@ private:
     }
 #endif
 
-    static std::vector<char> readFile(const std::string& filename)
+    //Reads straight into 32-bit words, so the code is aligned the way VkShaderModuleCreateInfo requires
+    static bool tryReadSpirvFile(const std::string& filename, std::vector<uint32_t>& code)
     {
         std::ifstream file(filename, std::ios::ate | std::ios::binary);
 
         if(!file.is_open())
         {
             std::cout << "Failed to open file " << filename.c_str() << std::endl;
-            exit(1);
+            return false;
         }
 
+        //SPIR-V is a stream of 32-bit words; anything else is a truncated or half-written file
         size_t fileSize = (size_t)file.tellg();
-        std::vector<char> buffer(fileSize);
+        if(fileSize == 0 || fileSize % sizeof(uint32_t) != 0)
+        {
+            std::cout << "Invalid SPIR-V size " << fileSize << " in " << filename.c_str() << std::endl;
+            return false;
+        }
+
+        code.resize(fileSize / sizeof(uint32_t));
         file.seekg(0);
-        file.read(buffer.data(), fileSize);
+        file.read(reinterpret_cast<char*>(code.data()), fileSize);
         file.close();
 
-        return buffer;
+        return true;
     }
 
     void initWindow()
@@ -293,23 +529,31 @@ private:
         createSurface();
         pickPhysicalDevice();
         createLogicalDevice();
+        createPipelineCache();
         createSwapChain();
         createImageViews();
         createRenderPass();
-        createDescriptorSetLayout();
+        createCommonSamplers();
+        createDescriptorSetLayouts();
+        createPipelineLayout();
+        createCullPipeline();
+        setupPipelineRegistry();
         createGraphicsPipeline();
         createCommandPool();
         createDepthResources();
         createFramebuffers();
         createTextureImage();
         createTextureImageView();
-        createTextureSampler();
         createVertIndexBuffers();
         createUniformBuffer();
-        createDescriptorPool();
-        createDescriptorSet();
+        createObjectUniformBuffer();
+        createInstanceBuffer();
+        createDescriptorAllocators();
+        createDescriptorSets();
+        createSceneObjects();
         createCommandBuffers();
-        createSemaphores();
+        createSyncObjects();
+        startShaderWatcher();
     }
 
     void createDepthResources()
@@ -321,7 +565,8 @@ private:
         transitionImageLayout(depthImage, depthFormat, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, 1);
     }
 
-    VkFormat findSupportedFormat(const std::vector<VkFormat>& candidates, VkImageTiling tiling, VkFormatFeatureFlags features)
+    //Returns VK_FORMAT_UNDEFINED if none of the candidates are supported
+    VkFormat tryFindSupportedFormat(const std::vector<VkFormat>& candidates, VkImageTiling tiling, VkFormatFeatureFlags features)
     {
         for(VkFormat format : candidates)
         {
@@ -334,8 +579,18 @@ private:
                 return format;
         }
 
-        std::cout << "Failed to find supported format" << std::endl;
-        exit(1);
+        return VK_FORMAT_UNDEFINED;
+    }
+
+    VkFormat findSupportedFormat(const std::vector<VkFormat>& candidates, VkImageTiling tiling, VkFormatFeatureFlags features)
+    {
+        VkFormat format = tryFindSupportedFormat(candidates, tiling, features);
+        if(format == VK_FORMAT_UNDEFINED)
+        {
+            std::cout << "Failed to find supported format" << std::endl;
+            exit(1);
+        }
+        return format;
     }
 
     VkFormat findDepthFormat()
@@ -352,36 +607,78 @@ private:
         return format == VK_FORMAT_D32_SFLOAT_S8_UINT || format == VK_FORMAT_D24_UNORM_S8_UINT;
     }
 
-    void createTextureSampler()
+    //Candidates are in order of preference, smallest first. Mipmaps are generated by linear blits, so those must be supported too.
+    VkFormat findTextureFormat(const std::vector<VkFormat>& candidates)
+    {
+        return findSupportedFormat(
+            candidates,
+            VK_IMAGE_TILING_OPTIMAL,
+            VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT | VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT
+        );
+    }
+
+    static VkDeviceSize getTextureTexelSize(VkFormat format)
+    {
+        switch(format)
+        {
+            case VK_FORMAT_B10G11R11_UFLOAT_PACK32:
+                return sizeof(uint32_t);
+            case VK_FORMAT_R16G16B16A16_SFLOAT:
+                return 4 * sizeof(uint16_t);
+            case VK_FORMAT_R32G32B32A32_SFLOAT:
+                return 4 * sizeof(float);
+            default:
+                return 4;
+        }
+    }
+
+    //maxLod is unclamped, so one sampler suits textures with any number of mip levels
+    VkSampler getTextureSampler(VkFilter filter, VkSamplerAddressMode addressMode)
     {
         VkSamplerCreateInfo samplerInfo = {};
         samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
-        samplerInfo.magFilter = VK_FILTER_LINEAR;   //VK_FILTER_NEAREST for pixelly image
-        samplerInfo.minFilter = VK_FILTER_LINEAR;
-        samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
-        samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
-        samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
-        samplerInfo.anisotropyEnable = VK_TRUE;     //Possible config option for performance
-        samplerInfo.maxAnisotropy = 16;
+        samplerInfo.magFilter = filter;
+        samplerInfo.minFilter = filter;
+        samplerInfo.addressModeU = addressMode;
+        samplerInfo.addressModeV = addressMode;
+        samplerInfo.addressModeW = addressMode;
+        samplerInfo.anisotropyEnable = (filter == VK_FILTER_LINEAR) ? VK_TRUE : VK_FALSE;     //Possible config option for performance
+        samplerInfo.maxAnisotropy = std::min(16.0f, maxSamplerAnisotropy);
         samplerInfo.borderColor = VK_BORDER_COLOR_INT_TRANSPARENT_BLACK;
         samplerInfo.unnormalizedCoordinates = VK_FALSE;
         samplerInfo.compareEnable = VK_FALSE;
         samplerInfo.compareOp = VK_COMPARE_OP_ALWAYS;
-        samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+        samplerInfo.mipmapMode = (filter == VK_FILTER_LINEAR) ? VK_SAMPLER_MIPMAP_MODE_LINEAR : VK_SAMPLER_MIPMAP_MODE_NEAREST;
         samplerInfo.mipLodBias = 0.0f;
         samplerInfo.minLod = 0.0f;
-        samplerInfo.maxLod = (float)textureMipLevels;
+        samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
 
-        if(vkCreateSampler(device, &samplerInfo, NULL, &textureSampler) != VK_SUCCESS)
+        VkSampler sampler = samplerCache.getSampler(device, samplerInfo);
+        if(sampler == VK_NULL_HANDLE)
         {
             std::cout << "Failed to create texture sampler" << std::endl;
             exit(1);
         }
+        return sampler;
+    }
+
+    //Before the set layouts, which the common samplers are baked into
+    void createCommonSamplers()
+    {
+        commonSamplers[SAMPLER_LINEAR_REPEAT] = getTextureSampler(VK_FILTER_LINEAR, VK_SAMPLER_ADDRESS_MODE_REPEAT);
+        commonSamplers[SAMPLER_LINEAR_CLAMP] = getTextureSampler(VK_FILTER_LINEAR, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE);
+        commonSamplers[SAMPLER_NEAREST_REPEAT] = getTextureSampler(VK_FILTER_NEAREST, VK_SAMPLER_ADDRESS_MODE_REPEAT);
+        commonSamplers[SAMPLER_NEAREST_CLAMP] = getTextureSampler(VK_FILTER_NEAREST, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE);
+
+        if(bindlessTexturesSupported)
+            layoutCache.setImmutableSamplers(DESCRIPTOR_SET_MATERIAL, BINDLESS_SAMPLER_BINDING, std::vector<VkSampler>(commonSamplers, commonSamplers + COMMON_SAMPLER_COUNT));
+        else
+            layoutCache.setImmutableSamplers(DESCRIPTOR_SET_MATERIAL, 0, { commonSamplers[SAMPLER_LINEAR_REPEAT] });
     }
 
     void createTextureImageView()
     {
-        textureImageView = createImageView(textureImage, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_ASPECT_COLOR_BIT, textureMipLevels);
+        textureImageView = createImageView(textureImage, textureFormat, VK_IMAGE_ASPECT_COLOR_BIT, textureMipLevels);
     }
 
     VkImageView createImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags, uint32_t mipLevels)
@@ -410,8 +707,26 @@ private:
     void createTextureImage()
     {
         int texWidth, texHeight, texChannels;
-        stbi_uc* pixels = stbi_load("textures/texture.jpg", &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
-        VkDeviceSize imageSize = texWidth * texHeight * 4;
+        void* pixels;
+
+        //HDR and 16-bit sources go to float formats instead of being truncated to 8 bits per channel
+        bool isHdr = stbi_is_hdr(TEXTURE_PATH) != 0;
+        bool is16Bit = !isHdr && isPng16(TEXTURE_PATH);
+        if(isHdr)
+        {
+            pixels = stbi_loadf(TEXTURE_PATH, &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
+            textureFormat = findTextureFormat({ VK_FORMAT_B10G11R11_UFLOAT_PACK32, VK_FORMAT_R16G16B16A16_SFLOAT, VK_FORMAT_R32G32B32A32_SFLOAT });
+        }
+        else if(is16Bit)
+        {
+            pixels = loadPng16(TEXTURE_PATH, &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
+            textureFormat = findTextureFormat({ VK_FORMAT_R16G16B16A16_SFLOAT, VK_FORMAT_R32G32B32A32_SFLOAT });
+        }
+        else
+        {
+            pixels = stbi_load(TEXTURE_PATH, &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
+            textureFormat = VK_FORMAT_R8G8B8A8_UNORM;
+        }
 
         if(!pixels)
         {
@@ -419,6 +734,9 @@ private:
             exit(1);
         }
 
+        size_t pixelCount = (size_t)texWidth * (size_t)texHeight;
+        VkDeviceSize imageSize = pixelCount * getTextureTexelSize(textureFormat);
+
         textureMipLevels = (uint32_t)std::floor(std::log2(std::max(texWidth, texHeight))) + 1;
 
         VkBuffer stagingBuffer;
@@ -427,17 +745,32 @@ private:
 
         void* data;
         vkMapMemory(device, stagingBufferMemory, 0, imageSize, 0, &data);
-        memcpy(data, pixels, static_cast<size_t>(imageSize));
+        //Convert straight into the staging memory rather than through a temporary copy
+        if(textureFormat == VK_FORMAT_B10G11R11_UFLOAT_PACK32)
+            packRgbaFloatToB10G11R11((const float*)pixels, (uint32_t*)data, pixelCount);
+        else if(textureFormat == VK_FORMAT_R16G16B16A16_SFLOAT && isHdr)
+            convertFloatToHalf((const float*)pixels, (uint16_t*)data, pixelCount * 4);
+        else if(textureFormat == VK_FORMAT_R16G16B16A16_SFLOAT)
+            convertUnorm16ToHalf((const uint16_t*)pixels, (uint16_t*)data, pixelCount * 4);
+        else if(textureFormat == VK_FORMAT_R32G32B32A32_SFLOAT && is16Bit)
+        {
+            const uint16_t* src = (const uint16_t*)pixels;
+            float* dst = (float*)data;
+            for(size_t i = 0; i < pixelCount * 4; i++)
+                dst[i] = src[i] / 65535.0f;
+        }
+        else
+            memcpy(data, pixels, static_cast<size_t>(imageSize));
         vkUnmapMemory(device, stagingBufferMemory);
 
         stbi_image_free(pixels);
 
         //TODO: VK_FORMAT_BC1_RGBA_UNORM_BLOCK for DXT-compressed images
-        createImage(texWidth, texHeight, textureMipLevels, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, textureImage, textureImageMemory);
+        createImage(texWidth, texHeight, textureMipLevels, textureFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, textureImage, textureImageMemory);
 
-        transitionImageLayout(textureImage, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, textureMipLevels);
+        transitionImageLayout(textureImage, textureFormat, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, textureMipLevels);
         copyBufferToImage(stagingBuffer, textureImage, (uint32_t)texWidth, (uint32_t)texHeight);
-        //transitionImageLayout(textureImage, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, textureMipLevels);
+        //transitionImageLayout(textureImage, textureFormat, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, textureMipLevels);
 
         vkDestroyBuffer(device, stagingBuffer, NULL);
         vkFreeMemory(device, stagingBufferMemory, NULL);
@@ -735,73 +1068,213 @@ private:
         endSingleTimeCommands(commandBuffer);
     }
 
-    void createDescriptorSet()
+    //Cached sets are written the first time they're drawn with; only the bindless set is made up front
+    void createDescriptorSets()
     {
-        //Create the descriptor set
-        VkDescriptorSetLayout layouts[] = { descriptorSetLayout };
-        VkDescriptorSetAllocateInfo allocInfo = {};
-        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-        allocInfo.descriptorPool = descriptorPool;
-        allocInfo.descriptorSetCount = 1;
-        allocInfo.pSetLayouts = layouts;
+        if(bindlessTexturesSupported)
+            bindlessMaterialSet = allocateDescriptorSet(bindlessSetAllocator, materialSetLayout, bindlessTextureCapacity);
 
-        if(vkAllocateDescriptorSets(device, &allocInfo, &descriptorSet) != VK_SUCCESS)  //Note: Automagically freed
-        {
-            std::cout << "Failed to allocate descriptor set" << std::endl;
-            exit(1);
-        }
+        createMaterial(textureImageView, SAMPLER_LINEAR_REPEAT);
+    }
+
+    //With per-frame recording the command buffer only lives for its frame, so the set can too, and is written fresh
+    //from this frame's transient allocator. Pre-recorded command buffers outlive any one frame, so they use a cached set.
+    //Uses the transient allocator, which isn't thread-safe, so only call from the thread recording the primary buffer.
+    VkDescriptorSet getFrameDescriptorSet()
+    {
+        if(!options.perFrameRecording)
+            return getCachedDescriptorSet(frameSetLayout, { DescriptorResource::forBuffer(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, uniformBuffer, 0, sizeof(UniformBufferObject)) });
 
-        //Create descriptors
+        VkDescriptorSet frameSet = allocateTransientDescriptorSet(frameSetLayout);
         VkDescriptorBufferInfo bufferInfo = {};
         bufferInfo.buffer = uniformBuffer;
         bufferInfo.offset = 0;
         bufferInfo.range = sizeof(UniformBufferObject);
 
+        VkWriteDescriptorSet descriptorWrite = {};
+        descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrite.dstSet = frameSet;
+        descriptorWrite.dstBinding = 0;
+        descriptorWrite.dstArrayElement = 0;
+        descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        descriptorWrite.descriptorCount = 1;
+        descriptorWrite.pBufferInfo = &bufferInfo;
+        vkUpdateDescriptorSets(device, 1, &descriptorWrite, 0, NULL);
+        return frameSet;
+    }
+
+    //Bound with a dynamic offset of objectUniformStride times the object's index
+    VkDescriptorSet getDrawDescriptorSet()
+    {
+        return getCachedDescriptorSet(drawSetLayout, { DescriptorResource::forBuffer(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, objectUniformBuffer, 0, sizeof(ObjectUniforms)) });
+    }
+
+    VkDescriptorSet getCullDescriptorSet()
+    {
+        return getCachedDescriptorSet(cullSetLayout, {
+            DescriptorResource::forBuffer(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, uniformBuffer, 0, sizeof(UniformBufferObject)),
+            DescriptorResource::forBuffer(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, objectBoundsBuffer, 0, VK_WHOLE_SIZE),
+            DescriptorResource::forBuffer(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, drawRecordBuffer, 0, VK_WHOLE_SIZE),
+            DescriptorResource::forBuffer(3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, drawCommandBuffer, 0, VK_WHOLE_SIZE),
+            DescriptorResource::forBuffer(4, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, drawCountBuffer, 0, VK_WHOLE_SIZE)
+        });
+    }
+
+    //Not with push descriptors; see pushMaterialDescriptors()
+    VkDescriptorSet getMaterialDescriptorSet(uint32_t material)
+    {
+        if(bindlessTexturesSupported)
+            return bindlessMaterialSet;
+        //The sampler is immutable in the layout, so only the image view is written
+        return getCachedDescriptorSet(materialSetLayout, { DescriptorResource::forImage(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, materials[material].imageView, VK_NULL_HANDLE, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL) });
+    }
+
+    //Writes the material's texture straight into the command buffer, with no set to allocate, update, or look up.
+    //The sampler is immutable in the layout, so only the image view is pushed.
+    void pushMaterialDescriptors(VkCommandBuffer commandBuffer, uint32_t material)
+    {
         VkDescriptorImageInfo imageInfo = {};
         imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-        imageInfo.imageView = textureImageView;
-        imageInfo.sampler = textureSampler;
+        imageInfo.imageView = materials[material].imageView;
+
+        VkWriteDescriptorSet descriptorWrite = {};
+        descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrite.dstSet = VK_NULL_HANDLE;    //Ignored for pushes
+        descriptorWrite.dstBinding = 0;
+        descriptorWrite.dstArrayElement = 0;
+        descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        descriptorWrite.descriptorCount = 1;
+        descriptorWrite.pImageInfo = &imageInfo;
+        cmdPushDescriptorSet(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, DESCRIPTOR_SET_MATERIAL, 1, &descriptorWrite);
+    }
 
-        std::array<VkWriteDescriptorSet, 2> descriptorWrites = {};
+    VkDescriptorSet getCachedDescriptorSet(VkDescriptorSetLayout layout, const std::vector<DescriptorResource>& resources)
+    {
+        VkDescriptorSet descriptorSet = descriptorSetCache.get(layout, resources);
+        if(descriptorSet == VK_NULL_HANDLE)
+        {
+            std::cout << "Failed to allocate descriptor set" << std::endl;
+            exit(1);
+        }
+        return descriptorSet;
+    }
 
-        descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        descriptorWrites[0].dstSet = descriptorSet;
-        descriptorWrites[0].dstBinding = 0;
-        descriptorWrites[0].dstArrayElement = 0;
-        descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-        descriptorWrites[0].descriptorCount = 1;
-        descriptorWrites[0].pBufferInfo = &bufferInfo;
+    //Returns the material index. The image view must outlive the material.
+    //Without bindless textures only SAMPLER_LINEAR_REPEAT is available, since it's baked into the material set layout;
+    //other samplers fall back to it.
+    uint32_t createMaterial(VkImageView imageView, CommonSampler sampler)
+    {
+        if(!bindlessTexturesSupported && sampler != SAMPLER_LINEAR_REPEAT)
+        {
+            std::cout << "Material sampler " << sampler << " isn't in the material set layout; using SAMPLER_LINEAR_REPEAT" << std::endl;
+            sampler = SAMPLER_LINEAR_REPEAT;
+        }
 
-        descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        descriptorWrites[1].dstSet = descriptorSet;
-        descriptorWrites[1].dstBinding = 1;
-        descriptorWrites[1].dstArrayElement = 0;
-        descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-        descriptorWrites[1].descriptorCount = 1;
-        descriptorWrites[1].pImageInfo = &imageInfo;
+        Material material = {};
+        material.imageView = imageView;
+        material.sampler = sampler;
+        if(bindlessTexturesSupported)
+            material.bindlessId = writeBindlessMaterial(imageView, sampler);
 
-        vkUpdateDescriptorSets(device, descriptorWrites.size(), descriptorWrites.data(), 0, NULL);
+        materials.push_back(material);
+        return (uint32_t)(materials.size() - 1);
     }
 
-    void createDescriptorPool()
+    //Writes the texture into the next free slot of the bindless array. The sampler table is immutable and holds
+    //every CommonSampler. The set is update-after-bind, so this is safe while command buffers using it are
+    //recorded or in flight, as long as they don't draw with the new slot yet.
+    //Returns the material's bindless ID.
+    uint32_t writeBindlessMaterial(VkImageView imageView, CommonSampler sampler)
     {
-        std::array<VkDescriptorPoolSize, 2> poolSizes = {};
-        poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-        poolSizes[0].descriptorCount = 1;
-        poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-        poolSizes[1].descriptorCount = 1;
+        if(bindlessTextureCount >= bindlessTextureCapacity)
+        {
+            std::cout << "Too many bindless textures; raise MAX_BINDLESS_TEXTURES" << std::endl;
+            exit(1);
+        }
 
-        VkDescriptorPoolCreateInfo poolInfo = {};
-        poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-        poolInfo.poolSizeCount = poolSizes.size();
-        poolInfo.pPoolSizes = poolSizes.data();
-        poolInfo.maxSets = 1;
+        uint32_t textureIndex = bindlessTextureCount++;
+        VkDescriptorImageInfo imageInfo = {};
+        imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        imageInfo.imageView = imageView;
+
+        VkWriteDescriptorSet descriptorWrite = {};
+        descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrite.dstSet = bindlessMaterialSet;
+        descriptorWrite.dstBinding = BINDLESS_TEXTURE_BINDING;
+        descriptorWrite.dstArrayElement = textureIndex;
+        descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+        descriptorWrite.descriptorCount = 1;
+        descriptorWrite.pImageInfo = &imageInfo;
+        vkUpdateDescriptorSets(device, 1, &descriptorWrite, 0, NULL);
+
+        return textureIndex | ((uint32_t)sampler << BINDLESS_TEXTURE_INDEX_BITS);
+    }
 
-        if(vkCreateDescriptorPool(device, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS)
+    //variableDescriptorCount sizes the runtime array of a layout that has one; leave 0 otherwise
+    VkDescriptorSet allocateDescriptorSet(DescriptorAllocator& allocator, VkDescriptorSetLayout layout, uint32_t variableDescriptorCount = 0)
+    {
+        VkDescriptorSet descriptorSet = allocator.allocate(layout, variableDescriptorCount);  //Note: Automagically freed with the pool
+        if(descriptorSet == VK_NULL_HANDLE)
         {
-            std::cout << "Failed to create descriptor pool" << std::endl;
+            std::cout << "Failed to allocate descriptor set" << std::endl;
             exit(1);
         }
+        return descriptorSet;
+    }
+
+    //For sets that are rewritten every frame. Valid until this frame slot's fence next signals.
+    VkDescriptorSet allocateTransientDescriptorSet(VkDescriptorSetLayout layout)
+    {
+        return allocateDescriptorSet(transientSetAllocators[currentFrame], layout);
+    }
+
+    void createDescriptorAllocators()
+    {
+        if(bindlessTexturesSupported)
+            bindlessSetAllocator.init(device, 1, getDescriptorPoolRatios(shaderInterface, DESCRIPTOR_SET_MATERIAL), VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT_EXT);
+
+        //Cached and transient sets can be of any non-bindless, non-push layout, so their pools cover every type the shaders use
+        std::vector<DescriptorPoolRatio> ratios;
+        for(uint32_t set = 0; set < DESCRIPTOR_SET_COUNT; set++)
+        {
+            if(LayoutCache::hasUnsizedArray(shaderInterface, set) || set == layoutCache.getPushDescriptorSet())
+                continue;
+            for(const DescriptorPoolRatio& ratio : getDescriptorPoolRatios(shaderInterface, set))
+                ratios.push_back(ratio);
+        }
+        if(options.gpuCulling)
+        {
+            for(const DescriptorPoolRatio& ratio : getDescriptorPoolRatios(cullInterface, 0))
+                ratios.push_back(ratio);
+        }
+        descriptorSetCache.init(device, DESCRIPTOR_SET_CACHE_CAPACITY, MAX_FRAMES_IN_FLIGHT, DESCRIPTOR_POOL_INITIAL_SETS, ratios);
+        for(DescriptorAllocator& allocator : transientSetAllocators)
+            allocator.init(device, DESCRIPTOR_POOL_INITIAL_SETS, ratios);
+    }
+
+    //Descriptors per set of the given set number, by type, from the shaders' bindings for it
+    std::vector<DescriptorPoolRatio> getDescriptorPoolRatios(const ShaderReflection& reflection, uint32_t set)
+    {
+        std::vector<DescriptorPoolRatio> ratios;
+        for(const ReflectedBinding& binding : reflection.bindings)
+        {
+            if(binding.set != set)
+                continue;
+
+            //Runtime-sized arrays are allocated at full capacity
+            uint32_t descriptorCount = (binding.descriptorCount != 0) ? binding.descriptorCount : layoutCache.getUnsizedArrayCapacity();
+            auto found = std::find_if(ratios.begin(), ratios.end(), [&binding](const DescriptorPoolRatio& ratio) { return ratio.type == binding.descriptorType; });
+            if(found != ratios.end())
+                found->descriptorsPerSet += descriptorCount;
+            else
+            {
+                DescriptorPoolRatio ratio = {};
+                ratio.type = binding.descriptorType;
+                ratio.descriptorsPerSet = (float)descriptorCount;
+                ratios.push_back(ratio);
+            }
+        }
+        return ratios;
     }
 
     void createUniformBuffer()
@@ -810,30 +1283,47 @@ private:
         createBuffer(bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, uniformBuffer, uniformBufferMemory);
     }
 
-    void createDescriptorSetLayout()
+    //Holds every scene object's ObjectUniforms, written when objects are created and left mapped
+    void createObjectUniformBuffer()
+    {
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+        VkDeviceSize alignment = std::max(properties.limits.minUniformBufferOffsetAlignment, (VkDeviceSize)1);
+        objectUniformStride = (sizeof(ObjectUniforms) + alignment - 1) / alignment * alignment;
+
+        VkDeviceSize bufferSize = objectUniformStride * MAX_SCENE_OBJECTS;
+        createBuffer(bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, objectUniformBuffer, objectUniformBufferMemory);
+        vkMapMemory(device, objectUniformBufferMemory, 0, bufferSize, 0, &objectUniformData);
+    }
+
+    //Only while no submitted frame is still reading the buffer, since every object shares it
+    void writeObjectUniforms()
     {
-        VkDescriptorSetLayoutBinding uboLayoutBinding = {};
-        uboLayoutBinding.binding = 0;
-        uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-        uboLayoutBinding.descriptorCount = 1;
-        uboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
-        uboLayoutBinding.pImmutableSamplers = NULL;
+        for(size_t i = 0; i < sceneObjects.size(); i++)
+            memcpy((char*)objectUniformData + i * objectUniformStride, &sceneObjects[i].uniforms, sizeof(ObjectUniforms));
+    }
 
-        //TODO: Multiple descriptor sets via layout(set = 0, binding = 0) uniform UniformBufferObject { ... }
-        VkDescriptorSetLayoutBinding samplerLayoutBinding = {};
-        samplerLayoutBinding.binding = 1;
-        samplerLayoutBinding.descriptorCount = 1;
-        samplerLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-        samplerLayoutBinding.pImmutableSamplers = nullptr;
-        samplerLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    void createDescriptorSetLayouts()
+    {
+        layoutCache.setUnsizedArrayCapacity(bindlessTextureCapacity);
+        if(pushDescriptorsSupported)
+            layoutCache.setPushDescriptorSet(DESCRIPTOR_SET_MATERIAL);
+        if(!reflectShaders(SHADER_VERT, getDefaultFragShader(), ShaderOverrides(), shaderInterface))
+        {
+            std::cout << "Failed to reflect shader interface" << std::endl;
+            exit(1);
+        }
 
-        std::array<VkDescriptorSetLayoutBinding, 2> bindings = { uboLayoutBinding, samplerLayoutBinding };
-        VkDescriptorSetLayoutCreateInfo layoutInfo = {};
-        layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-        layoutInfo.bindingCount = bindings.size();
-        layoutInfo.pBindings = bindings.data();
+        if(shaderInterface.pushConstantSize > sizeof(ObjectPushConstants))
+        {
+            std::cout << "Shader push constants don't fit ObjectPushConstants" << std::endl;
+            exit(1);
+        }
 
-        if(vkCreateDescriptorSetLayout(device, &layoutInfo, NULL, &descriptorSetLayout) != VK_SUCCESS)
+        frameSetLayout = layoutCache.getDescriptorSetLayout(device, shaderInterface, DESCRIPTOR_SET_FRAME);
+        materialSetLayout = layoutCache.getDescriptorSetLayout(device, shaderInterface, DESCRIPTOR_SET_MATERIAL);
+        drawSetLayout = layoutCache.getDescriptorSetLayout(device, shaderInterface, DESCRIPTOR_SET_DRAW);
+        if(frameSetLayout == VK_NULL_HANDLE || materialSetLayout == VK_NULL_HANDLE || drawSetLayout == VK_NULL_HANDLE)
         {
             std::cout << "Failed to create descriptor set layout" << std::endl;
             exit(1);
@@ -870,6 +1360,121 @@ private:
         vkFreeMemory(device, stagingBufferMemory, NULL);
     }
 
+    bool isInstancingEnabled()
+    {
+        return options.instanceCount > 0 || options.instanceBenchmark;
+    }
+
+    void createInstanceBuffer()
+    {
+        if(!isInstancingEnabled())
+            return;
+
+        createBuffer(sizeof(InstanceData) * MAX_INSTANCES, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, instanceBuffer, instanceBufferMemory);
+        if(options.gpuCulling)
+        {
+            createBuffer(sizeof(glm::vec4) * MAX_INSTANCES, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, objectBoundsBuffer, objectBoundsBufferMemory);
+            createBuffer(sizeof(CullDrawRecord) * MAX_INSTANCES, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, drawRecordBuffer, drawRecordBufferMemory);
+            createBuffer(sizeof(VkDrawIndexedIndirectCommand) * MAX_INSTANCES, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, drawCommandBuffer, drawCommandBufferMemory);
+            createBuffer(sizeof(uint32_t), VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, drawCountBuffer, drawCountBufferMemory);
+        }
+        setInstances(createInstanceGrid(options.instanceCount));
+    }
+
+    //Uploads through a staging buffer. Waits for the device to go idle first, since in-flight frames may still be
+    //reading the old instances; fine for occasional changes, not for streaming new data every frame.
+    void setInstances(const std::vector<InstanceData>& instances)
+    {
+        if(instances.size() > MAX_INSTANCES)
+        {
+            std::cout << "Too many instances; raise MAX_INSTANCES" << std::endl;
+            exit(1);
+        }
+
+        instanceCount = (uint32_t)instances.size();
+        commandBufferDirty.assign(commandBuffers.size(), true);
+        if(instances.empty())
+            return;
+
+        vkDeviceWaitIdle(device);
+        uploadToBuffer(instanceBuffer, instances.data(), sizeof(InstanceData) * instances.size());
+        if(!options.gpuCulling)
+            return;
+
+        //Every instance is its own object to the cull pass, drawing the whole mesh
+        glm::vec4 meshBounds = getMeshBoundingSphere();
+        std::vector<glm::vec4> bounds(instances.size());
+        std::vector<CullDrawRecord> records(instances.size());
+        for(size_t i = 0; i < instances.size(); i++)
+        {
+            bounds[i] = getWorldBoundingSphere(instances[i].model, meshBounds);
+            records[i].indexCount = (uint32_t)indices.size();
+        }
+        uploadToBuffer(objectBoundsBuffer, bounds.data(), sizeof(glm::vec4) * bounds.size());
+        uploadToBuffer(drawRecordBuffer, records.data(), sizeof(CullDrawRecord) * records.size());
+    }
+
+    //Center in xyz, radius in w. Around the center of the vertices' bounding box, so not the tightest sphere, but close.
+    glm::vec4 getMeshBoundingSphere()
+    {
+        glm::vec3 minPos = vertices[0].pos;
+        glm::vec3 maxPos = vertices[0].pos;
+        for(const Vertex& vertex : vertices)
+        {
+            minPos = glm::min(minPos, vertex.pos);
+            maxPos = glm::max(maxPos, vertex.pos);
+        }
+
+        glm::vec3 center = (minPos + maxPos) * 0.5f;
+        float radius = 0.0f;
+        for(const Vertex& vertex : vertices)
+            radius = std::max(radius, glm::length(vertex.pos - center));
+        return glm::vec4(center, radius);
+    }
+
+    //meshBounds (from getMeshBoundingSphere()) moved by model. Scaled by model's largest axis scale, so it still
+    //contains the mesh under non-uniform scale.
+    static glm::vec4 getWorldBoundingSphere(const glm::mat4& model, const glm::vec4& meshBounds)
+    {
+        float scale = std::max(glm::length(glm::vec3(model[0])), std::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+        return glm::vec4(glm::vec3(model * glm::vec4(glm::vec3(meshBounds), 1.0f)), meshBounds.w * scale);
+    }
+
+    //Copies through a staging buffer and waits for it to finish. Only while the GPU isn't using dstBuffer.
+    void uploadToBuffer(VkBuffer dstBuffer, const void* srcData, VkDeviceSize size)
+    {
+        VkBuffer stagingBuffer;
+        VkDeviceMemory stagingBufferMemory;
+        createBuffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+
+        void* data;
+        vkMapMemory(device, stagingBufferMemory, 0, size, 0, &data);
+        memcpy(data, srcData, (size_t)size);
+        vkUnmapMemory(device, stagingBufferMemory);
+
+        copyBuffer(stagingBuffer, dstBuffer, size);
+
+        vkDestroyBuffer(device, stagingBuffer, NULL);
+        vkFreeMemory(device, stagingBufferMemory, NULL);
+    }
+
+    //Square grid of small copies of the mesh filling the area the camera orbits, tinted by position
+    std::vector<InstanceData> createInstanceGrid(uint32_t count)
+    {
+        std::vector<InstanceData> instances(count);
+        uint32_t side = (uint32_t)std::ceil(std::sqrt((double)count));
+        float spacing = 4.0f / std::max(side, 1u);
+        for(uint32_t i = 0; i < count; i++)
+        {
+            float u = (float)(i % side) / side;
+            float v = (float)(i / side) / side;
+            glm::mat4 model = glm::translate(glm::mat4(1.0f), glm::vec3(u * 4.0f - 2.0f + spacing * 0.5f, v * 4.0f - 2.0f + spacing * 0.5f, -0.75f));
+            instances[i].model = glm::scale(model, glm::vec3(spacing * 0.8f));
+            instances[i].color = glm::vec4(u, v, 1.0f - u, 1.0f);
+        }
+        return instances;
+    }
+
     void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& bufferMemory)
     {
         VkBufferCreateInfo bufferInfo = {};
@@ -932,107 +1537,426 @@ private:
         exit(1);
     }
 
-    void createSemaphores()
+    void createSyncObjects()
     {
+        imageAvailableSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
+        renderFinishedSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
+        inFlightFences.resize(MAX_FRAMES_IN_FLIGHT);
+
         VkSemaphoreCreateInfo semaphoreInfo = {};
         semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 
-        if(vkCreateSemaphore(device, &semaphoreInfo, NULL, &imageAvailableSemaphore) != VK_SUCCESS ||
-            vkCreateSemaphore(device, &semaphoreInfo, NULL, &renderFinishedSemaphore) != VK_SUCCESS)
+        //Start signaled so the first wait on each frame doesn't block forever
+        VkFenceCreateInfo fenceInfo = {};
+        fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+        fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+
+        for(size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
         {
-            std::cout << "Failed to create semaphores" << std::endl;
-            exit(1);
+            if(vkCreateSemaphore(device, &semaphoreInfo, NULL, &imageAvailableSemaphores[i]) != VK_SUCCESS ||
+                vkCreateSemaphore(device, &semaphoreInfo, NULL, &renderFinishedSemaphores[i]) != VK_SUCCESS ||
+                vkCreateFence(device, &fenceInfo, NULL, &inFlightFences[i]) != VK_SUCCESS)
+            {
+                std::cout << "Failed to create synchronization objects" << std::endl;
+                exit(1);
+            }
+        }
+    }
+
+    //Run destroy once every frame that might still reference the object has finished on the GPU
+    void deferDestroy(std::function<void()> destroy)
+    {
+        deletionQueue.push_back(std::make_pair(frameNumber + MAX_FRAMES_IN_FLIGHT, destroy));
+    }
+
+    //Pass everything = true only when the device is idle
+    void flushDeletionQueue(bool everything)
+    {
+        for(size_t i = 0; i < deletionQueue.size(); )
+        {
+            if(everything || deletionQueue[i].first <= frameNumber)
+            {
+                deletionQueue[i].second();
+                deletionQueue.erase(deletionQueue.begin() + i);
+            }
+            else
+                i++;
         }
     }
 
+    //Pre-recorded: one command buffer per swapchain image, recorded here and again only when something changes.
+    //Per-frame: one per frame in flight, each in its own transient pool that drawFrame() resets and records into every frame.
     void createCommandBuffers()
     {
         //Allocate command buffer
-        commandBuffers.resize(swapChainFramebuffers.size());
+        commandBuffers.resize(options.perFrameRecording ? MAX_FRAMES_IN_FLIGHT : swapChainFramebuffers.size());
 
-        VkCommandBufferAllocateInfo allocInfo = {};
-        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-        allocInfo.commandPool = commandPool;
-        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-        allocInfo.commandBufferCount = (uint32_t)commandBuffers.size();
-
-        if(vkAllocateCommandBuffers(device, &allocInfo, commandBuffers.data()) != VK_SUCCESS)
+        if(options.perFrameRecording)
         {
-            std::cout << "Failed to allocate command buffers" << std::endl;
-            exit(1);
+            frameCommandPools.resize(commandBuffers.size());
+            for(size_t i = 0; i < commandBuffers.size(); i++)
+            {
+                frameCommandPools[i] = createRecordingCommandPool();
+                allocateCommandBuffers(frameCommandPools[i], VK_COMMAND_BUFFER_LEVEL_PRIMARY, 1, &commandBuffers[i]);
+            }
         }
+        else
+            allocateCommandBuffers(commandPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, (uint32_t)commandBuffers.size(), commandBuffers.data());
+        createSecondaryCommandBuffers();
 
-        for(size_t i = 0; i < commandBuffers.size(); i++)
+        if(!options.perFrameRecording)
         {
-            //Start buffer recording
-            VkCommandBufferBeginInfo beginInfo = {};
-            beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-            beginInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
-            beginInfo.pInheritanceInfo = NULL;
-
-            vkBeginCommandBuffer(commandBuffers[i], &beginInfo);
-
-            std::array<VkClearValue, 2> clearValues = {};
-            clearValues[0].color = { 0.0f, 0.0f, 0.0f, 1.0f };
-            clearValues[1].depthStencil = { 1.0f, 0 };
-
-            //Start render pass
-            VkRenderPassBeginInfo renderPassInfo = {};
-            renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-            renderPassInfo.renderPass = renderPass;
-            renderPassInfo.framebuffer = swapChainFramebuffers[i];
-            renderPassInfo.renderArea.offset = { 0, 0 };
-            renderPassInfo.renderArea.extent = swapChainExtent;
-            renderPassInfo.clearValueCount = clearValues.size();
-            renderPassInfo.pClearValues = clearValues.data();
-            vkCmdBeginRenderPass(commandBuffers[i], &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
-
-            //Draw
-            vkCmdBindPipeline(commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
-
-            VkBuffer vertexBuffers[] = { combinedBuffer };
-            VkDeviceSize offsets[] = { sizeof(indices[0]) * indices.size() };   //Vertex buffer after index buffer in data
-            vkCmdBindVertexBuffers(commandBuffers[i], 0, 1, vertexBuffers, offsets);
-            vkCmdBindIndexBuffer(commandBuffers[i], combinedBuffer, 0, VK_INDEX_TYPE_UINT16);
-
-            //Bind descriptor sets
-            vkCmdBindDescriptorSets(commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSet, 0, NULL);
+            for(size_t i = 0; i < commandBuffers.size(); i++)
+                recordCommandBuffer(i, (uint32_t)i);
+        }
 
-            vkCmdDrawIndexed(commandBuffers[i], (uint32_t)indices.size(), 1, 0, 0, 0);
-            vkCmdEndRenderPass(commandBuffers[i]);
+        commandBufferDirty.assign(commandBuffers.size(), false);
+        imagesInFlight.assign(swapChainImages.size(), VK_NULL_HANDLE);
+    }
 
-            if(vkEndCommandBuffer(commandBuffers[i]) != VK_SUCCESS)
+    //Command pools are externally synchronized, so each chunk recorded in parallel gets a pool of its own. A pool
+    //holds just its one buffer and is reset whole before the buffer is re-recorded, which is cheaper than resetting
+    //buffers individually.
+    void createSecondaryCommandBuffers()
+    {
+        size_t chunkCount = recordPool.getThreadCount();
+        secondaryCommandPools.assign(commandBuffers.size(), std::vector<VkCommandPool>(chunkCount));
+        secondaryCommandBuffers.assign(commandBuffers.size(), std::vector<VkCommandBuffer>(chunkCount));
+        for(size_t i = 0; i < commandBuffers.size(); i++)
+        {
+            for(size_t chunk = 0; chunk < chunkCount; chunk++)
             {
-                std::cout << "Failed to record command buffer" << std::endl;
-                exit(1);
+                secondaryCommandPools[i][chunk] = createRecordingCommandPool();
+                allocateCommandBuffers(secondaryCommandPools[i][chunk], VK_COMMAND_BUFFER_LEVEL_SECONDARY, 1, &secondaryCommandBuffers[i][chunk]);
             }
         }
     }
 
-    void createCommandPool()
+    //For pools that are only ever reset whole. With per-frame recording that happens every frame, so they're transient.
+    VkCommandPool createRecordingCommandPool()
     {
         QueueFamilyIndices queueFamilyIndices = findQueueFamilies(physicalDevice);
 
         VkCommandPoolCreateInfo poolInfo = {};
         poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
         poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily;
-        poolInfo.flags = 0;
+        poolInfo.flags = options.perFrameRecording ? VK_COMMAND_POOL_CREATE_TRANSIENT_BIT : 0;
 
-        if(vkCreateCommandPool(device, &poolInfo, NULL, &commandPool) != VK_SUCCESS)
+        VkCommandPool pool;
+        if(vkCreateCommandPool(device, &poolInfo, NULL, &pool) != VK_SUCCESS)
         {
             std::cout << "Failed to create command pool" << std::endl;
             exit(1);
         }
+        return pool;
     }
 
-    void createFramebuffers()
+    void allocateCommandBuffers(VkCommandPool pool, VkCommandBufferLevel level, uint32_t count, VkCommandBuffer* buffers)
     {
-        swapChainFramebuffers.resize(swapChainImageViews.size());
-        for(size_t i = 0; i < swapChainImageViews.size(); i++)
+        VkCommandBufferAllocateInfo allocInfo = {};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.commandPool = pool;
+        allocInfo.level = level;
+        allocInfo.commandBufferCount = count;
+
+        if(vkAllocateCommandBuffers(device, &allocInfo, buffers) != VK_SUCCESS)
         {
-            std::array<VkImageView, 2> attachments = {
-                swapChainImageViews[i],
-                depthImageView
+            std::cout << "Failed to allocate command buffers" << std::endl;
+            exit(1);
+        }
+    }
+
+    void createSceneObjects()
+    {
+        std::vector<InstanceData> grid = createInstanceGrid(options.objectCount);
+        for(uint32_t i = 0; i < options.objectCount; i++)
+        {
+            SceneObject object = {};
+            object.uniforms.model = (options.objectCount > 1) ? grid[i].model : glm::mat4(1.0f);
+            object.constants.objectId = i;
+            object.material = 0;
+            sceneObjects.push_back(object);
+        }
+
+        //Draw order groups objects by material so each material's set is bound once (and, when bindless, draws with the same texture stay together)
+        std::stable_sort(sceneObjects.begin(), sceneObjects.end(), [](const SceneObject& a, const SceneObject& b) { return a.material < b.material; });
+
+        if(sceneObjects.size() > MAX_SCENE_OBJECTS)
+        {
+            std::cout << "Too many scene objects; raise MAX_SCENE_OBJECTS" << std::endl;
+            exit(1);
+        }
+        writeObjectUniforms();
+
+        glm::vec4 meshBounds = getMeshBoundingSphere();
+        sceneObjectBounds.clear();
+        sceneObjectBounds.reserve(sceneObjects.size());
+        visibleObjects.resize(sceneObjects.size());
+        for(size_t i = 0; i < sceneObjects.size(); i++)
+        {
+            glm::vec4 bounds = getWorldBoundingSphere(sceneObjects[i].uniforms.model, meshBounds);
+            sceneObjectBounds.add(bounds.x, bounds.y, bounds.z, bounds.w);
+            visibleObjects[i] = (uint32_t)i;
+        }
+    }
+
+    //Leaves only the scene objects inside the camera's frustum in visibleObjects, culling in chunks on recordPool when
+    //there are enough of them. Only worth it when recording every frame; pre-recorded command buffers would go stale
+    //as soon as the camera moved, so they draw everything and leave it to the GPU to clip.
+    void cullSceneObjects()
+    {
+        size_t chunkCount = std::min(recordPool.getThreadCount(), sceneObjectBounds.size() / CULL_MIN_OBJECTS_PER_CHUNK);
+        sceneCuller.cullSpheres(cameraFrustum, sceneObjectBounds, recordPool, std::max(chunkCount, (size_t)1), visibleObjects);
+    }
+
+    //Records commandBuffers[slot] to draw into swapchain image imageIndex. slot is the image itself, or with per-frame
+    //recording the frame in flight. Only call while commandBuffers[slot] isn't pending on the GPU.
+    void recordCommandBuffer(size_t slot, uint32_t imageIndex)
+    {
+        recordCommandBuffer(slot, imageIndex, recordPool, getRecordChunkCount(recordPool.getThreadCount()));
+    }
+
+    //Enough chunks to keep up to threadCount threads busy, without giving any of them too little to be worth it
+    size_t getRecordChunkCount(size_t threadCount)
+    {
+        size_t chunkCount = std::min(threadCount, visibleObjects.size() / RECORD_MIN_OBJECTS_PER_CHUNK);
+        return std::max(chunkCount, (size_t)1);
+    }
+
+    //With chunkCount > 1, the visible scene objects are split into that many contiguous runs, each recorded into its own
+    //secondary command buffer on threadPool and executed from the primary in order. Otherwise draws are recorded inline.
+    //chunkCount can't be more than recordPool's thread count, since that's how many secondary buffers there are.
+    void recordCommandBuffer(size_t slot, uint32_t imageIndex, ThreadPool& threadPool, size_t chunkCount)
+    {
+        VkCommandBuffer commandBuffer = commandBuffers[slot];
+
+        //Start buffer recording. Not simultaneous use: drawFrame() waits for an image's (or frame's) last submit to
+        //finish before submitting its command buffer again, so it's never pending twice, and drivers can optimize more.
+        VkCommandBufferBeginInfo beginInfo = {};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = options.perFrameRecording ? VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT : 0;
+        beginInfo.pInheritanceInfo = NULL;
+
+        vkBeginCommandBuffer(commandBuffer, &beginInfo);
+
+        if(options.gpuCulling && instanceCount > 0)
+            recordCullPass(commandBuffer);
+
+        std::array<VkClearValue, 2> clearValues = {};
+        clearValues[0].color = { 0.0f, 0.0f, 0.0f, 1.0f };
+        clearValues[1].depthStencil = { 1.0f, 0 };
+
+        //Start render pass
+        VkRenderPassBeginInfo renderPassInfo = {};
+        renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+        renderPassInfo.renderPass = renderPass;
+        renderPassInfo.framebuffer = swapChainFramebuffers[imageIndex];
+        renderPassInfo.renderArea.offset = { 0, 0 };
+        renderPassInfo.renderArea.extent = swapChainExtent;
+        renderPassInfo.clearValueCount = clearValues.size();
+        renderPassInfo.pClearValues = clearValues.data();
+
+        //Fetched here rather than per chunk, since a transient one can only be allocated from this thread
+        VkDescriptorSet frameSet = getFrameDescriptorSet();
+        if(chunkCount <= 1)
+        {
+            vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+            recordDraws(commandBuffer, frameSet, 0, visibleObjects.size(), true);
+        }
+        else
+        {
+            vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+
+            //The instanced draw goes last, as it does inline
+            std::vector<std::future<void>> chunks;
+            for(size_t chunk = 0; chunk < chunkCount; chunk++)
+            {
+                size_t firstVisible = visibleObjects.size() * chunk / chunkCount;
+                size_t endVisible = visibleObjects.size() * (chunk + 1) / chunkCount;
+                bool drawInstances = (chunk == chunkCount - 1);
+                chunks.push_back(threadPool.submit([this, slot, imageIndex, chunk, frameSet, firstVisible, endVisible, drawInstances]() { recordSecondaryCommandBuffer(slot, imageIndex, chunk, frameSet, firstVisible, endVisible, drawInstances); }));
+            }
+            for(std::future<void>& chunk : chunks)
+                chunk.wait();
+            vkCmdExecuteCommands(commandBuffer, (uint32_t)chunkCount, secondaryCommandBuffers[slot].data());
+        }
+        vkCmdEndRenderPass(commandBuffer);
+
+        if(vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
+        {
+            std::cout << "Failed to record command buffer" << std::endl;
+            exit(1);
+        }
+    }
+
+    //Runs on a recordPool thread. Only touches its own chunk's pool, and the descriptor set cache, which is thread safe.
+    void recordSecondaryCommandBuffer(size_t slot, uint32_t imageIndex, size_t chunk, VkDescriptorSet frameSet, size_t firstVisible, size_t endVisible, bool drawInstances)
+    {
+        VkCommandBuffer commandBuffer = secondaryCommandBuffers[slot][chunk];
+        vkResetCommandPool(device, secondaryCommandPools[slot][chunk], 0);
+
+        VkCommandBufferInheritanceInfo inheritanceInfo = {};
+        inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+        inheritanceInfo.renderPass = renderPass;
+        inheritanceInfo.subpass = 0;
+        inheritanceInfo.framebuffer = swapChainFramebuffers[imageIndex];
+
+        VkCommandBufferBeginInfo beginInfo = {};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT | (options.perFrameRecording ? VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT : 0);
+        beginInfo.pInheritanceInfo = &inheritanceInfo;
+
+        vkBeginCommandBuffer(commandBuffer, &beginInfo);
+        recordDraws(commandBuffer, frameSet, firstVisible, endVisible, drawInstances);
+        if(vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
+        {
+            std::cout << "Failed to record command buffer" << std::endl;
+            exit(1);
+        }
+    }
+
+    //Draws the scene objects in visibleObjects[firstVisible, endVisible), then the instances if drawInstances, inside the render pass.
+    //Binds all its own state, since secondary command buffers don't inherit any.
+    void recordDraws(VkCommandBuffer commandBuffer, VkDescriptorSet frameSet, size_t firstVisible, size_t endVisible, bool drawInstances)
+    {
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
+        recordDynamicState(commandBuffer);
+
+        VkBuffer vertexBuffers[] = { combinedBuffer };
+        VkDeviceSize offsets[] = { sizeof(indices[0]) * indices.size() };   //Vertex buffer after index buffer in data
+        vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
+        vkCmdBindIndexBuffer(commandBuffer, combinedBuffer, 0, VK_INDEX_TYPE_UINT16);
+
+        //Bind descriptor sets. Per-frame once; per-material only when it changes (pushed, if supported), or once for bindless textures.
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, DESCRIPTOR_SET_FRAME, 1, &frameSet, 0, NULL);
+        if(bindlessTexturesSupported)
+            vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, DESCRIPTOR_SET_MATERIAL, 1, &bindlessMaterialSet, 0, NULL);
+
+        //Per-object uniforms all come through the one set; each draw just moves its dynamic offset
+        VkDescriptorSet drawSet = getDrawDescriptorSet();
+
+        uint32_t boundMaterial = UINT32_MAX;
+        for(size_t visibleIndex = firstVisible; visibleIndex < endVisible; visibleIndex++)
+        {
+            size_t objectIndex = visibleObjects[visibleIndex];
+            const SceneObject& object = sceneObjects[objectIndex];
+            uint32_t dynamicOffset = (uint32_t)(objectIndex * objectUniformStride);
+            vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, DESCRIPTOR_SET_DRAW, 1, &drawSet, 1, &dynamicOffset);
+
+            ObjectPushConstants constants = object.constants;
+            if(bindlessTexturesSupported)
+                constants.materialId = materials[object.material].bindlessId;
+            else if(object.material != boundMaterial && pushDescriptorsSupported)
+            {
+                pushMaterialDescriptors(commandBuffer, object.material);
+                boundMaterial = object.material;
+            }
+            else if(object.material != boundMaterial)
+            {
+                VkDescriptorSet materialSet = getMaterialDescriptorSet(object.material);
+                vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, DESCRIPTOR_SET_MATERIAL, 1, &materialSet, 0, NULL);
+                boundMaterial = object.material;
+            }
+            vkCmdPushConstants(commandBuffer, pipelineLayout, shaderInterface.pushConstantStageFlags, 0, shaderInterface.pushConstantSize, &constants);
+            vkCmdDrawIndexed(commandBuffer, (uint32_t)indices.size(), 1, 0, 0, 0);
+        }
+
+        //Every instance in one draw. The pipeline layout is the same, so the sets bound above stay bound.
+        //With GPU culling, the cull pass has written one indirect draw per instance instead, each picking its
+        //InstanceData through firstInstance; with a draw count the GPU skips straight past the culled ones.
+        if(drawInstances && instanceCount > 0)
+        {
+            vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, instancedPipeline);
+            VkBuffer instanceVertexBuffers[] = { combinedBuffer, instanceBuffer };
+            VkDeviceSize instanceOffsets[] = { offsets[0], 0 };
+            vkCmdBindVertexBuffers(commandBuffer, 0, 2, instanceVertexBuffers, instanceOffsets);
+            if(options.gpuCulling && drawIndirectCountSupported)
+                cmdDrawIndexedIndirectCount(commandBuffer, drawCommandBuffer, 0, drawCountBuffer, 0, instanceCount, sizeof(VkDrawIndexedIndirectCommand));
+            else if(options.gpuCulling)
+                vkCmdDrawIndexedIndirect(commandBuffer, drawCommandBuffer, 0, instanceCount, sizeof(VkDrawIndexedIndirectCommand));
+            else
+                vkCmdDrawIndexed(commandBuffer, (uint32_t)indices.size(), instanceCount, 0, 0, 0);
+        }
+    }
+
+    //Frustum culls the instances into drawCommandBuffer (and drawCountBuffer) for this frame's indirect draw.
+    //Must be recorded outside the render pass.
+    void recordCullPass(VkCommandBuffer commandBuffer)
+    {
+        //Every frame culls into the same buffers, so wait for earlier frames' indirect draws to finish reading them,
+        //and make their cull pass's writes available before this one's fill and writes land on top
+        VkMemoryBarrier barrier = {};
+        barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, NULL, 0, NULL);
+
+        if(drawIndirectCountSupported)
+        {
+            vkCmdFillBuffer(commandBuffer, drawCountBuffer, 0, sizeof(uint32_t), 0);
+            barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+            vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, NULL, 0, NULL);
+        }
+
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipeline);
+        VkDescriptorSet cullSet = getCullDescriptorSet();
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipelineLayout, 0, 1, &cullSet, 0, NULL);
+        vkCmdPushConstants(commandBuffer, cullPipelineLayout, cullInterface.pushConstantStageFlags, 0, sizeof(instanceCount), &instanceCount);
+        vkCmdDispatch(commandBuffer, (instanceCount + CULL_WORKGROUP_SIZE - 1) / CULL_WORKGROUP_SIZE, 1, 1);
+
+        barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, 0, 1, &barrier, 0, NULL, 0, NULL);
+    }
+
+    //Set all state the pipeline declares dynamic. Must follow vkCmdBindPipeline.
+    void recordDynamicState(VkCommandBuffer commandBuffer)
+    {
+        VkViewport viewport = {};
+        viewport.x = 0.0f;
+        viewport.y = 0.0f;
+        viewport.width = (float)swapChainExtent.width;
+        viewport.height = (float)swapChainExtent.height;
+        viewport.minDepth = 0.0f;
+        viewport.maxDepth = 1.0f;
+        vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+        VkRect2D scissor = {};
+        scissor.offset = { 0, 0 };
+        scissor.extent = swapChainExtent;
+        vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+        const float blendConstants[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+        vkCmdSetLineWidth(commandBuffer, 1.0f);
+        vkCmdSetDepthBias(commandBuffer, 0.0f, 0.0f, 0.0f);
+        vkCmdSetBlendConstants(commandBuffer, blendConstants);
+    }
+
+    void createCommandPool()
+    {
+        QueueFamilyIndices queueFamilyIndices = findQueueFamilies(physicalDevice);
+
+        VkCommandPoolCreateInfo poolInfo = {};
+        poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily;
+        poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;    //Command buffers are re-recorded individually when pipelines change
+
+        if(vkCreateCommandPool(device, &poolInfo, NULL, &commandPool) != VK_SUCCESS)
+        {
+            std::cout << "Failed to create command pool" << std::endl;
+            exit(1);
+        }
+    }
+
+    void createFramebuffers()
+    {
+        swapChainFramebuffers.resize(swapChainImageViews.size());
+        for(size_t i = 0; i < swapChainImageViews.size(); i++)
+        {
+            std::array<VkImageView, 2> attachments = {
+                swapChainImageViews[i],
+                depthImageView
             };
 
             VkFramebufferCreateInfo framebufferInfo = {};
@@ -1119,16 +2043,505 @@ private:
         }
     }
 
+    void setupPipelineRegistry()
+    {
+        pipelineRegistry.setBuilder([this](const PipelineDescription& description) { return buildGraphicsPipeline(description); });
+        for(uint32_t part = 0; part < PIPELINE_LIBRARY_PART_COUNT; part++)
+            pipelineLibraryParts[part].setBuilder([this, part](const PipelineDescription& description) { return tryBuildGraphicsPipeline(description, ShaderOverrides(), 1 << part); });
+
+        //Precompile what the last session drew with. Runs on the worker pool while the rest of init loads assets.
+        std::vector<PipelineDescription> loggedPipelines = loadPipelineUsageLog();
+        //Queue the default pipeline first so createGraphicsPipeline() doesn't wait behind the others
+        PipelineDescription defaultDescription = getDefaultPipelineDescription();
+        std::stable_partition(loggedPipelines.begin(), loggedPipelines.end(), [&defaultDescription](const PipelineDescription& description) { return description == defaultDescription; });
+        pipelineRegistry.requestBatch(loggedPipelines, pipelineCompilePool);
+        std::cout << "Prewarming " << loggedPipelines.size() << " pipeline(s) from " << PIPELINE_USAGE_LOG_PATH << std::endl;
+    }
+
+    //Returns only the logged pipelines that can be built against the current render pass
+    std::vector<PipelineDescription> loadPipelineUsageLog()
+    {
+        std::vector<PipelineDescription> descriptions;
+        std::ifstream file(PIPELINE_USAGE_LOG_PATH, std::ios::binary);
+        if(!file.is_open())
+            return descriptions;
+
+        PipelineUsageLogHeader header = {};
+        if(!file.read((char*)&header, sizeof(header)) || header.magic != PIPELINE_USAGE_LOG_MAGIC || header.descriptionSize != sizeof(PipelineDescription))
+        {
+            std::cout << "Ignoring stale pipeline usage log " << PIPELINE_USAGE_LOG_PATH << std::endl;
+            return descriptions;
+        }
+
+        PipelineDescription current = getDefaultPipelineDescription();
+        for(uint32_t i = 0; i < header.descriptionCount; i++)
+        {
+            PipelineDescription description = {};
+            if(!file.read((char*)&description, sizeof(description)))
+                break;
+
+            //Every pipeline has to share pipelineLayout, which the other fragment shader's descriptors don't fit
+            if(description.vertShader >= SHADER_COUNT || description.fragShader != current.fragShader ||
+                (description.shaderFeatures >> SHADER_FEATURE_COUNT) != 0 ||
+                !isPipelineStateInRange(description) ||
+                description.colorFormat != current.colorFormat ||
+                description.depthFormat != current.depthFormat ||
+                description.sampleCount != current.sampleCount)
+                continue;
+            descriptions.push_back(description);
+        }
+        return descriptions;
+    }
+
+    //Whether every enum and flag in a logged description is one this app can build with, so a corrupt log
+    //can't cast garbage into the pipeline create info. Only features the device was created with are allowed:
+    //no tessellation or adjacency topologies, and no fillModeNonSolid.
+    static bool isPipelineStateInRange(const PipelineDescription& description)
+    {
+        return description.vertexLayout <= PIPELINE_VERTEX_LAYOUT_INSTANCED &&
+            description.topology <= VK_PRIMITIVE_TOPOLOGY_TRIANGLE_FAN &&
+            description.polygonMode == VK_POLYGON_MODE_FILL &&
+            (description.cullMode & ~(uint32_t)VK_CULL_MODE_FRONT_AND_BACK) == 0 &&
+            description.frontFace <= VK_FRONT_FACE_CLOCKWISE &&
+            description.depthTest <= VK_TRUE &&
+            description.depthWrite <= VK_TRUE &&
+            description.depthCompareOp <= VK_COMPARE_OP_ALWAYS &&
+            description.blendMode <= PIPELINE_BLEND_ADDITIVE &&
+            (description.colorWriteMask & ~(uint32_t)(VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT)) == 0;
+    }
+
+    void savePipelineUsageLog()
+    {
+        std::vector<PipelineDescription> descriptions = pipelineRegistry.getDescriptions(true);
+        if(descriptions.empty())
+            return;
+
+        PipelineUsageLogHeader header = {};
+        header.magic = PIPELINE_USAGE_LOG_MAGIC;
+        header.descriptionSize = sizeof(PipelineDescription);
+        header.descriptionCount = (uint32_t)descriptions.size();
+
+        std::ofstream file(PIPELINE_USAGE_LOG_PATH, std::ios::binary | std::ios::trunc);
+        if(!file.is_open())
+        {
+            std::cout << "Failed to write pipeline usage log " << PIPELINE_USAGE_LOG_PATH << std::endl;
+            return;
+        }
+        file.write((const char*)&header, sizeof(header));
+        file.write((const char*)descriptions.data(), descriptions.size() * sizeof(PipelineDescription));
+    }
+
     void createGraphicsPipeline()
     {
-        std::vector<char> vertShaderCode = readFile("shaders/vert.spv");
-        std::vector<char> fragShaderCode = readFile("shaders/frag.spv");
+        //Only the default pipeline is needed to start drawing. It's built here unless a worker already has it;
+        //every other material permutation compiles across the worker pool and is picked up as it finishes.
+        pipelineCompileStartTime = std::chrono::high_resolution_clock::now();
+        graphicsPipeline = pipelineRegistry.get(getDefaultPipelineDescription());
+        if(isInstancingEnabled())
+            instancedPipeline = pipelineRegistry.get(getInstancedPipelineDescription());
+        pendingPipelines = pipelineRegistry.requestBatch(getMaterialPipelineDescriptions(), pipelineCompilePool);
+    }
+
+    //All the pipeline permutations materials can use, default first
+    std::vector<PipelineDescription> getMaterialPipelineDescriptions()
+    {
+        std::vector<PipelineDescription> descriptions;
+        const uint32_t blendModes[] = { PIPELINE_BLEND_OPAQUE, PIPELINE_BLEND_ALPHA, PIPELINE_BLEND_ADDITIVE };
+        const uint32_t cullModes[] = { VK_CULL_MODE_BACK_BIT, VK_CULL_MODE_NONE };
+        const uint32_t shaderFeatureSets[] = {
+            SHADER_FEATURE_TEXTURED,
+            SHADER_FEATURE_TEXTURED | SHADER_FEATURE_VERTEX_COLOR,
+            SHADER_FEATURE_TEXTURED | SHADER_FEATURE_FOG
+        };
+
+        for(uint32_t shaderFeatures : shaderFeatureSets)
+        {
+            for(uint32_t cullMode : cullModes)
+            {
+                for(uint32_t blendMode : blendModes)
+                {
+                    PipelineDescription description = getPipelineVariant(shaderFeatures);
+                    description.cullMode = cullMode;
+                    description.blendMode = blendMode;
+                    //Blended geometry is drawn after opaque and shouldn't occlude what's behind it
+                    description.depthWrite = (blendMode == PIPELINE_BLEND_OPAQUE) ? VK_TRUE : VK_FALSE;
+                    descriptions.push_back(description);
+                }
+            }
+
+            //Cutouts (foliage, fences) are opaque with alpha testing instead of blending
+            PipelineDescription cutout = getPipelineVariant(shaderFeatures | SHADER_FEATURE_ALPHA_TEST);
+            cutout.cullMode = VK_CULL_MODE_NONE;
+            descriptions.push_back(cutout);
+        }
+        return descriptions;
+    }
+
+    //Report once every background pipeline compile has landed
+    void checkPendingPipelines()
+    {
+        if(pendingPipelines.empty())
+            return;
+
+        for(const auto& pipeline : pendingPipelines)
+        {
+            if(pipeline.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+                return;
+        }
+
+        auto endTime = std::chrono::high_resolution_clock::now();
+        std::cout << pendingPipelines.size() << " pipelines compiled on " << pipelineCompilePool.getThreadCount() << " thread(s) in "
+            << std::chrono::duration<double, std::milli>(endTime - pipelineCompileStartTime).count() << " ms" << std::endl;
+        pendingPipelines.clear();
+    }
+
+    //The default pipeline with a different set of ShaderFeature bits
+    PipelineDescription getPipelineVariant(uint32_t shaderFeatures)
+    {
+        PipelineDescription description = getDefaultPipelineDescription();
+        description.shaderFeatures = shaderFeatures;
+        return description;
+    }
+
+    PipelineDescription getInstancedPipelineDescription()
+    {
+        PipelineDescription description = getDefaultPipelineDescription();
+        description.vertShader = SHADER_VERT_INSTANCED;
+        description.vertexLayout = PIPELINE_VERTEX_LAYOUT_INSTANCED;
+        description.shaderFeatures = SHADER_FEATURE_TEXTURED | SHADER_FEATURE_VERTEX_COLOR;
+        description.cullMode = VK_CULL_MODE_NONE;
+        return description;
+    }
+
+    //Bindless materials take their textures from one array instead of a set per material, so they need their own shader
+    uint32_t getDefaultFragShader()
+    {
+        return bindlessTexturesSupported ? SHADER_FRAG_BINDLESS : SHADER_FRAG;
+    }
+
+    PipelineDescription getDefaultPipelineDescription()
+    {
+        PipelineDescription description = {};
+        description.vertShader = SHADER_VERT;
+        description.fragShader = getDefaultFragShader();
+        description.shaderFeatures = SHADER_FEATURE_TEXTURED;
+        description.vertexLayout = PIPELINE_VERTEX_LAYOUT_STANDARD;
+        description.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+        description.polygonMode = VK_POLYGON_MODE_FILL;
+        description.cullMode = VK_CULL_MODE_BACK_BIT;
+        description.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+        description.depthTest = VK_TRUE;
+        description.depthWrite = VK_TRUE;
+        description.depthCompareOp = VK_COMPARE_OP_LESS;
+        description.blendMode = PIPELINE_BLEND_OPAQUE;
+        description.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+        description.colorFormat = swapChainImageFormat;
+        description.depthFormat = findDepthFormat();
+        description.sampleCount = VK_SAMPLE_COUNT_1_BIT;
+        return description;
+    }
+
+    void createPipelineLayout()
+    {
+        pipelineLayout = layoutCache.getPipelineLayout(device, shaderInterface);
+        if(pipelineLayout == VK_NULL_HANDLE)
+        {
+            std::cout << "Failed to create pipeline layout" << std::endl;
+            exit(1);
+        }
+    }
+
+    //The only compute pipeline, so it's built here once rather than going through pipelineRegistry.
+    //Its layout is reflected from the shader like the graphics ones, and its set comes from descriptorSetCache.
+    void createCullPipeline()
+    {
+        if(!options.gpuCulling)
+            return;
+
+        const uint32_t* code;
+        size_t codeSize;
+        getShaderCode(SHADER_COMP_CULL, ShaderOverrides(), code, codeSize);
+        if(!reflectSpirv(code, codeSize, cullInterface) || cullInterface.pushConstantSize != sizeof(uint32_t))
+        {
+            std::cout << "Failed to reflect cull shader interface" << std::endl;
+            exit(1);
+        }
+
+        cullSetLayout = layoutCache.getDescriptorSetLayout(device, cullInterface, 0);
+        cullPipelineLayout = layoutCache.getPipelineLayout(device, cullInterface);
+        if(cullSetLayout == VK_NULL_HANDLE || cullPipelineLayout == VK_NULL_HANDLE)
+        {
+            std::cout << "Failed to create cull pipeline layout" << std::endl;
+            exit(1);
+        }
+
+        VkShaderModule cullShaderModule = tryCreateShaderModule(SHADER_COMP_CULL, ShaderOverrides());
+        if(cullShaderModule == VK_NULL_HANDLE)
+            exit(1);
+
+        //COMPACT: pack visible draws at the front when the draw count is read back on the GPU
+        VkBool32 compact = drawIndirectCountSupported ? VK_TRUE : VK_FALSE;
+        VkSpecializationMapEntry compactMapEntry = {};
+        compactMapEntry.constantID = 0;
+        compactMapEntry.offset = 0;
+        compactMapEntry.size = sizeof(VkBool32);
+
+        VkSpecializationInfo specializationInfo = {};
+        specializationInfo.mapEntryCount = 1;
+        specializationInfo.pMapEntries = &compactMapEntry;
+        specializationInfo.dataSize = sizeof(compact);
+        specializationInfo.pData = &compact;
+
+        VkComputePipelineCreateInfo pipelineInfo = {};
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+        pipelineInfo.stage.module = cullShaderModule;
+        pipelineInfo.stage.pName = "main";
+        pipelineInfo.stage.pSpecializationInfo = &specializationInfo;
+        pipelineInfo.layout = cullPipelineLayout;
+
+        VkResult result = vkCreateComputePipelines(device, pipelineCache, 1, &pipelineInfo, NULL, &cullPipeline);
+        vkDestroyShaderModule(device, cullShaderModule, NULL);
+        if(result != VK_SUCCESS)
+        {
+            std::cout << "Failed to create cull pipeline" << std::endl;
+            exit(1);
+        }
+    }
+
+    //Called by pipelineRegistry, once per unique description, possibly on several worker threads at once.
+    //With graphics pipeline libraries, fast-links from cached parts and queues an optimized link to replace it later.
+    VkPipeline buildGraphicsPipeline(const PipelineDescription& description)
+    {
+        //Library parts are built from the embedded shaders, so hot reloaded ones take the monolithic path
+        if(graphicsPipelineLibrarySupported && !hasShaderOverrides())
+        {
+            VkPipeline pipeline = tryLinkGraphicsPipeline(description, false);
+            if(pipeline != VK_NULL_HANDLE)
+            {
+                std::shared_future<VkPipeline> optimized = pipelineCompilePool.submit([this, description]() { return tryLinkGraphicsPipeline(description, true); }).share();
+                std::lock_guard<std::mutex> lock(optimizedPipelinesMutex);
+                pendingOptimizedPipelines.push_back(std::make_pair(description, optimized));
+                return pipeline;
+            }
+        }
+
+        VkPipeline pipeline = tryBuildGraphicsPipeline(description);
+        if(pipeline == VK_NULL_HANDLE)
+            exit(1);
+        return pipeline;
+    }
+
+    bool hasShaderOverrides()
+    {
+        std::lock_guard<std::mutex> lock(shaderOverridesMutex);
+        for(const auto& code : shaderOverrides)
+        {
+            if(code)
+                return true;
+        }
+        return false;
+    }
+
+    //Only the fields that affect one library part, so a part is shared by every pipeline that agrees on them.
+    //Render pass compatibility is kept in all of them. Parts without a stage still need a shader for
+    //reflection; they get the default one so it doesn't split the key.
+    PipelineDescription getLibraryPartDescription(uint32_t part, const PipelineDescription& description)
+    {
+        PipelineDescription partDescription = {};
+        partDescription.vertShader = SHADER_VERT;
+        partDescription.fragShader = getDefaultFragShader();
+        partDescription.colorFormat = description.colorFormat;
+        partDescription.depthFormat = description.depthFormat;
+        partDescription.sampleCount = description.sampleCount;
+
+        switch(1 << part)
+        {
+        case VK_GRAPHICS_PIPELINE_LIBRARY_VERTEX_INPUT_INTERFACE_BIT_EXT:
+            partDescription.vertShader = description.vertShader;    //Vertex input is reflected from it
+            partDescription.vertexLayout = description.vertexLayout;
+            partDescription.topology = description.topology;
+            break;
+        case VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT:
+            partDescription.vertShader = description.vertShader;
+            partDescription.vertexLayout = description.vertexLayout;    //The shader's inputs are checked against it
+            partDescription.polygonMode = description.polygonMode;
+            partDescription.cullMode = description.cullMode;
+            partDescription.frontFace = description.frontFace;
+            break;
+        case VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT:
+            partDescription.fragShader = description.fragShader;
+            partDescription.shaderFeatures = description.shaderFeatures;
+            partDescription.depthTest = description.depthTest;
+            partDescription.depthWrite = description.depthWrite;
+            partDescription.depthCompareOp = description.depthCompareOp;
+            break;
+        case VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_OUTPUT_INTERFACE_BIT_EXT:
+            partDescription.blendMode = description.blendMode;
+            partDescription.colorWriteMask = description.colorWriteMask;
+            break;
+        }
+        return partDescription;
+    }
+
+    //Links a complete pipeline from its four library parts, building any that aren't cached yet. A fast link costs
+    //a fraction of a monolithic build; an optimized link costs about the same as one but runs as fast when drawing.
+    VkPipeline tryLinkGraphicsPipeline(const PipelineDescription& description, bool optimize)
+    {
+        VkPipeline libraries[PIPELINE_LIBRARY_PART_COUNT];
+        for(uint32_t part = 0; part < PIPELINE_LIBRARY_PART_COUNT; part++)
+        {
+            libraries[part] = pipelineLibraryParts[part].get(getLibraryPartDescription(part, description));
+            if(libraries[part] == VK_NULL_HANDLE)
+                return VK_NULL_HANDLE;
+        }
 
-        //std::cout << "Vert shader length: " << vertShaderCode.size() << std::endl;
-        //std::cout << "Frag shader length: " << fragShaderCode.size() << std::endl;
+        VkPipelineLibraryCreateInfoKHR libraryInfo = {};
+        libraryInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LIBRARY_CREATE_INFO_KHR;
+        libraryInfo.libraryCount = PIPELINE_LIBRARY_PART_COUNT;
+        libraryInfo.pLibraries = libraries;
 
-        VkShaderModule vertShaderModule = createShaderModule(vertShaderCode);
-        VkShaderModule fragShaderModule = createShaderModule(fragShaderCode);
+        VkGraphicsPipelineCreateInfo pipelineInfo = {};
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+        pipelineInfo.pNext = &libraryInfo;
+        pipelineInfo.flags = optimize ? VK_PIPELINE_CREATE_LINK_TIME_OPTIMIZATION_BIT_EXT : 0;
+        pipelineInfo.layout = pipelineLayout;
+        pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+        pipelineInfo.basePipelineIndex = -1;
+
+        VkPipeline pipeline;
+        auto linkStartTime = std::chrono::high_resolution_clock::now();
+        if(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineInfo, NULL, &pipeline) != VK_SUCCESS)
+        {
+            std::cout << "Failed to link graphics pipeline!" << std::endl;
+            return VK_NULL_HANDLE;
+        }
+        auto linkEndTime = std::chrono::high_resolution_clock::now();
+        std::cout << "Graphics pipeline " << (optimize ? "optimized" : "fast-linked") << " in " << std::chrono::duration<double, std::milli>(linkEndTime - linkStartTime).count() << " ms" << std::endl;
+        return pipeline;
+    }
+
+    //Swap link-time optimized pipelines in for their fast-linked versions as they finish
+    void processOptimizedPipelines()
+    {
+        std::lock_guard<std::mutex> lock(optimizedPipelinesMutex);
+        bool replaced = false;
+        for(size_t i = 0; i < pendingOptimizedPipelines.size(); )
+        {
+            const auto& optimized = pendingOptimizedPipelines[i];
+            if(optimized.second.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+            {
+                i++;
+                continue;
+            }
+
+            //Linked from the embedded shaders, so it's stale once a hot reload has replaced them
+            VkPipeline newPipeline = optimized.second.get();
+            if(newPipeline != VK_NULL_HANDLE && hasShaderOverrides())
+                vkDestroyPipeline(device, newPipeline, NULL);
+            else if(newPipeline != VK_NULL_HANDLE)
+            {
+                VkPipeline oldPipeline = pipelineRegistry.replace(optimized.first, newPipeline);
+                replacePipelineHandle(oldPipeline, newPipeline);
+                VkDevice logicalDevice = device;
+                deferDestroy([logicalDevice, oldPipeline]() { vkDestroyPipeline(logicalDevice, oldPipeline, NULL); });
+                replaced = true;
+            }
+            pendingOptimizedPipelines.erase(pendingOptimizedPipelines.begin() + i);
+        }
+
+        if(replaced)
+            commandBufferDirty.assign(commandBuffers.size(), true);
+    }
+
+    //Points whichever pipeline handles were using oldPipeline at its replacement
+    void replacePipelineHandle(VkPipeline oldPipeline, VkPipeline newPipeline)
+    {
+        if(oldPipeline == graphicsPipeline)
+            graphicsPipeline = newPipeline;
+        if(oldPipeline == instancedPipeline)
+            instancedPipeline = newPipeline;
+    }
+
+    void discardOptimizedPipelines()
+    {
+        std::lock_guard<std::mutex> lock(optimizedPipelinesMutex);
+        for(const auto& optimized : pendingOptimizedPipelines)
+            vkDestroyPipeline(device, optimized.second.get(), NULL);
+        pendingOptimizedPipelines.clear();
+    }
+
+    //Returns VK_NULL_HANDLE on failure, so a bad shader during hot reload doesn't take the app down.
+    //Only reads state that is fixed while pipelines compile (device, layout, render pass), and pipelineCache
+    //is internally synchronized. Builds against the current render pass, which must be compatible with the description.
+    VkPipeline tryBuildGraphicsPipeline(const PipelineDescription& description)
+    {
+        ShaderOverrides overrides;
+        {
+            std::lock_guard<std::mutex> lock(shaderOverridesMutex);
+            overrides = shaderOverrides;
+        }
+        return tryBuildGraphicsPipeline(description, overrides);
+    }
+
+    //With libraryParts (VkGraphicsPipelineLibraryFlagsEXT), builds just those parts as a pipeline library instead
+    VkPipeline tryBuildGraphicsPipeline(const PipelineDescription& description, const ShaderOverrides& overrides, VkGraphicsPipelineLibraryFlagsEXT libraryParts = 0)
+    {
+        if(description.vertShader >= SHADER_COUNT || description.fragShader >= SHADER_COUNT)
+        {
+            std::cout << "Invalid shader in pipeline description" << std::endl;
+            return VK_NULL_HANDLE;
+        }
+
+        //Layout and vertex input come from the shaders themselves
+        ShaderReflection reflection;
+        if(!reflectShaders(description.vertShader, description.fragShader, overrides, reflection))
+        {
+            std::cout << "Failed to reflect shaders in pipeline description" << std::endl;
+            return VK_NULL_HANDLE;
+        }
+
+        //The descriptor set is allocated once for the default shaders' layout, so every pipeline has to be compatible with it.
+        //Compared by key, so mismatched or hot reloaded interfaces don't leave layouts of their own in the cache.
+        if(!layoutCache.matches(reflection, shaderInterface))
+        {
+            std::cout << "Shader interface doesn't match the pipeline layout in use" << std::endl;
+            return VK_NULL_HANDLE;
+        }
+
+        //Binding 0 is per vertex. Instanced layouts take the inputs from INSTANCE_FIRST_LOCATION on per instance, from binding 1.
+        bool instanced = (description.vertexLayout == PIPELINE_VERTEX_LAYOUT_INSTANCED);
+        std::vector<VkVertexInputAttributeDescription> attributeDescriptions;
+        std::array<VkVertexInputBindingDescription, 2> bindingDescriptions = {};
+        bindingDescriptions[0].binding = 0;
+        bindingDescriptions[0].stride = getReflectedVertexAttributes(reflection, 0, attributeDescriptions, 0, instanced ? INSTANCE_FIRST_LOCATION : UINT32_MAX);
+        bindingDescriptions[0].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+        bindingDescriptions[1].binding = 1;
+        bindingDescriptions[1].stride = instanced ? getReflectedVertexAttributes(reflection, 1, attributeDescriptions, INSTANCE_FIRST_LOCATION) : 0;
+        bindingDescriptions[1].inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
+
+        if(description.vertexLayout > PIPELINE_VERTEX_LAYOUT_INSTANCED || bindingDescriptions[0].stride != sizeof(Vertex) ||
+            (instanced && bindingDescriptions[1].stride != sizeof(InstanceData)))
+        {
+            std::cout << "Vertex shader inputs don't match the vertex layout in pipeline description" << std::endl;
+            return VK_NULL_HANDLE;
+        }
+
+        bool buildAll = (libraryParts == 0);
+        bool vertexInputPart = buildAll || (libraryParts & VK_GRAPHICS_PIPELINE_LIBRARY_VERTEX_INPUT_INTERFACE_BIT_EXT);
+        bool preRasterizationPart = buildAll || (libraryParts & VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT);
+        bool fragmentShaderPart = buildAll || (libraryParts & VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT);
+        bool fragmentOutputPart = buildAll || (libraryParts & VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_OUTPUT_INTERFACE_BIT_EXT);
+
+        VkShaderModule vertShaderModule = preRasterizationPart ? tryCreateShaderModule(description.vertShader, overrides) : VK_NULL_HANDLE;
+        VkShaderModule fragShaderModule = fragmentShaderPart ? tryCreateShaderModule(description.fragShader, overrides) : VK_NULL_HANDLE;
+        if((preRasterizationPart && vertShaderModule == VK_NULL_HANDLE) || (fragmentShaderPart && fragShaderModule == VK_NULL_HANDLE))
+        {
+            vkDestroyShaderModule(device, vertShaderModule, NULL);
+            vkDestroyShaderModule(device, fragShaderModule, NULL);
+            return VK_NULL_HANDLE;
+        }
 
         //Vert shader stage
         VkPipelineShaderStageCreateInfo vertShaderStageInfo = {};
@@ -1144,57 +2557,62 @@ private:
         fragShaderStageInfo.module = fragShaderModule;
         fragShaderStageInfo.pName = "main";
 
+        //Feature toggles. Constants not listed here (cutoff, fog range) keep the defaults in the shader source.
+        VkBool32 featureConstants[SHADER_FEATURE_COUNT];
+        VkSpecializationMapEntry featureMapEntries[SHADER_FEATURE_COUNT];
+        for(uint32_t i = 0; i < SHADER_FEATURE_COUNT; i++)
+        {
+            featureConstants[i] = (description.shaderFeatures & (1 << i)) ? VK_TRUE : VK_FALSE;
+            featureMapEntries[i].constantID = i;
+            featureMapEntries[i].offset = i * sizeof(VkBool32);
+            featureMapEntries[i].size = sizeof(VkBool32);
+        }
+
+        VkSpecializationInfo specializationInfo = {};
+        specializationInfo.mapEntryCount = SHADER_FEATURE_COUNT;
+        specializationInfo.pMapEntries = featureMapEntries;
+        specializationInfo.dataSize = sizeof(featureConstants);
+        specializationInfo.pData = featureConstants;
+        fragShaderStageInfo.pSpecializationInfo = &specializationInfo;
+
         //Create shader stages
-        VkPipelineShaderStageCreateInfo shaderStages[] = { vertShaderStageInfo, fragShaderStageInfo };
+        std::vector<VkPipelineShaderStageCreateInfo> shaderStages;
+        if(preRasterizationPart)
+            shaderStages.push_back(vertShaderStageInfo);
+        if(fragmentShaderPart)
+            shaderStages.push_back(fragShaderStageInfo);
 
         //Vertex input
-        auto bindingDescription = Vertex::getBindingDescription();
-        auto attributeDescriptions = Vertex::getAttributeDescriptions();
-
         VkPipelineVertexInputStateCreateInfo vertexInputInfo = {};
         vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-        vertexInputInfo.vertexBindingDescriptionCount = 1;
+        vertexInputInfo.vertexBindingDescriptionCount = instanced ? 2 : 1;
         vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
-        vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
+        vertexInputInfo.pVertexBindingDescriptions = bindingDescriptions.data();
         vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
 
-        //Input assembly: triangles in a list of vertices
+        //Input assembly
         VkPipelineInputAssemblyStateCreateInfo inputAssembly = {};
         inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-        inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+        inputAssembly.topology = (VkPrimitiveTopology)description.topology;
         inputAssembly.primitiveRestartEnable = VK_FALSE;
 
-        //Viewport assembly
-        VkViewport viewport = {};
-        viewport.x = 0.0f;
-        viewport.y = 0.0f;
-        viewport.width = (float)swapChainExtent.width;
-        viewport.height = (float)swapChainExtent.height;
-        viewport.minDepth = 0.0f;
-        viewport.maxDepth = 1.0f;
-
-        //Scissor rect
-        VkRect2D scissor = {};
-        scissor.offset = { 0, 0 };
-        scissor.extent = swapChainExtent;
-
-        //Viewport state
+        //Viewport state. Viewport and scissor are dynamic, so the pipeline doesn't depend on the swapchain extent
         VkPipelineViewportStateCreateInfo viewportState = {};
         viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
         viewportState.viewportCount = 1;
-        viewportState.pViewports = &viewport;
+        viewportState.pViewports = NULL;
         viewportState.scissorCount = 1;
-        viewportState.pScissors = &scissor;
+        viewportState.pScissors = NULL;
 
         //Rasterizer
         VkPipelineRasterizationStateCreateInfo rasterizer = {};
         rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
         rasterizer.depthClampEnable = VK_FALSE;
         rasterizer.rasterizerDiscardEnable = VK_FALSE;
-        rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+        rasterizer.polygonMode = (VkPolygonMode)description.polygonMode;
         rasterizer.lineWidth = 1.0f;
-        rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
-        rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+        rasterizer.cullMode = description.cullMode;
+        rasterizer.frontFace = (VkFrontFace)description.frontFace;
         rasterizer.depthBiasEnable = VK_FALSE;
         rasterizer.depthBiasConstantFactor = 0.0f;
         rasterizer.depthBiasClamp = 0.0f;
@@ -1204,7 +2622,7 @@ private:
         VkPipelineMultisampleStateCreateInfo multisampling = {};
         multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
         multisampling.sampleShadingEnable = VK_FALSE;
-        multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+        multisampling.rasterizationSamples = (VkSampleCountFlagBits)description.sampleCount;
         multisampling.minSampleShading = 1.0f;
         multisampling.pSampleMask = NULL;
         multisampling.alphaToCoverageEnable = VK_FALSE;
@@ -1213,16 +2631,16 @@ private:
         //Depth stencil
         VkPipelineDepthStencilStateCreateInfo depthStencil = {};
         depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
-        depthStencil.depthTestEnable = VK_TRUE;
-        depthStencil.depthWriteEnable = VK_TRUE;
-        depthStencil.depthCompareOp = VK_COMPARE_OP_LESS;
+        depthStencil.depthTestEnable = description.depthTest;
+        depthStencil.depthWriteEnable = description.depthWrite;
+        depthStencil.depthCompareOp = (VkCompareOp)description.depthCompareOp;
         depthStencil.depthBoundsTestEnable = VK_FALSE;
         depthStencil.minDepthBounds = 0.0f;
         depthStencil.maxDepthBounds = 1.0f;
 
         //Color blending
         VkPipelineColorBlendAttachmentState colorBlendAttachment = {};
-        colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+        colorBlendAttachment.colorWriteMask = description.colorWriteMask;
         colorBlendAttachment.blendEnable = VK_FALSE;
         colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_ONE;
         colorBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ZERO;
@@ -1230,22 +2648,22 @@ private:
         colorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
         colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
         colorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
-        //Alpha blending
-        /*
-        colorBlendAttachment.blendEnable = VK_TRUE;
-        colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
-        colorBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
-        colorBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
-        colorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
-        colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
-        colorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
-        */
+        if(description.blendMode == PIPELINE_BLEND_ALPHA)
+        {
+            colorBlendAttachment.blendEnable = VK_TRUE;
+            colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+            colorBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+        }
+        else if(description.blendMode == PIPELINE_BLEND_ADDITIVE)
+        {
+            colorBlendAttachment.blendEnable = VK_TRUE;
+            colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+            colorBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE;
+        }
 
         VkPipelineColorBlendStateCreateInfo colorBlending = {};
         colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
         colorBlending.logicOpEnable = VK_FALSE;
-        //Alpha blending
-        //colorBlending.logicOpEnable = VK_TRUE;
         colorBlending.logicOp = VK_LOGIC_OP_COPY;
         colorBlending.attachmentCount = 1;
         colorBlending.pAttachments = &colorBlendAttachment;
@@ -1254,78 +2672,330 @@ private:
         colorBlending.blendConstants[2] = 0.0f;
         colorBlending.blendConstants[3] = 0.0f;
 
-        //Fill in state dynamically
-        /*
-        VkDynamicState dynamicStates[] = {
-            VK_DYNAMIC_STATE_VIEWPORT,
-            VK_DYNAMIC_STATE_LINE_WIDTH
-        };
+        //Fill in state dynamically (set in recordDynamicState()). Each library part declares the dynamic state it owns.
+        std::vector<VkDynamicState> dynamicStates;
+        if(preRasterizationPart)
+        {
+            dynamicStates.push_back(VK_DYNAMIC_STATE_VIEWPORT);
+            dynamicStates.push_back(VK_DYNAMIC_STATE_SCISSOR);
+            dynamicStates.push_back(VK_DYNAMIC_STATE_LINE_WIDTH);
+            dynamicStates.push_back(VK_DYNAMIC_STATE_DEPTH_BIAS);
+        }
+        if(fragmentOutputPart)
+            dynamicStates.push_back(VK_DYNAMIC_STATE_BLEND_CONSTANTS);
 
         VkPipelineDynamicStateCreateInfo dynamicState = {};
         dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-        dynamicState.dynamicStateCount = 2;
-        dynamicState.pDynamicStates = dynamicStates;
-        */
-
-        //Create pipeline layout
-        VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
-        pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-        pipelineLayoutInfo.setLayoutCount = 1;
-        pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout;
-        pipelineLayoutInfo.pushConstantRangeCount = 0;
-        pipelineLayoutInfo.pPushConstantRanges = NULL;
-
-        if(vkCreatePipelineLayout(device, &pipelineLayoutInfo, NULL, &pipelineLayout) != VK_SUCCESS)
-        {
-            std::cout << "Failed to create pipeline layout" << std::endl;
-            exit(1);
-        }
+        dynamicState.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
+        dynamicState.pDynamicStates = dynamicStates.data();
 
         //Create pipeline!
         VkGraphicsPipelineCreateInfo pipelineInfo = {};
         pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-        pipelineInfo.stageCount = 2;    //Vert & frag
-        pipelineInfo.pStages = shaderStages;
-        pipelineInfo.pVertexInputState = &vertexInputInfo;
-        pipelineInfo.pInputAssemblyState = &inputAssembly;
-        pipelineInfo.pViewportState = &viewportState;
-        pipelineInfo.pRasterizationState = &rasterizer;
-        pipelineInfo.pMultisampleState = &multisampling;
-        pipelineInfo.pDepthStencilState = &depthStencil;
-        pipelineInfo.pColorBlendState = &colorBlending;
-        pipelineInfo.pDynamicState = NULL;
+        pipelineInfo.stageCount = static_cast<uint32_t>(shaderStages.size());
+        pipelineInfo.pStages = shaderStages.data();
+        pipelineInfo.pVertexInputState = vertexInputPart ? &vertexInputInfo : NULL;
+        pipelineInfo.pInputAssemblyState = vertexInputPart ? &inputAssembly : NULL;
+        pipelineInfo.pViewportState = preRasterizationPart ? &viewportState : NULL;
+        pipelineInfo.pRasterizationState = preRasterizationPart ? &rasterizer : NULL;
+        pipelineInfo.pMultisampleState = (fragmentShaderPart || fragmentOutputPart) ? &multisampling : NULL;
+        pipelineInfo.pDepthStencilState = fragmentShaderPart ? &depthStencil : NULL;
+        pipelineInfo.pColorBlendState = fragmentOutputPart ? &colorBlending : NULL;
+        pipelineInfo.pDynamicState = dynamicStates.empty() ? NULL : &dynamicState;
         pipelineInfo.layout = pipelineLayout;
         pipelineInfo.renderPass = renderPass;
         pipelineInfo.subpass = 0;
         pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
         pipelineInfo.basePipelineIndex = -1;
 
-        if(vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, NULL, &graphicsPipeline) != VK_SUCCESS)
+        //Parts keep what the driver needs to optimize across them again when they're linked
+        VkGraphicsPipelineLibraryCreateInfoEXT libraryInfo = {};
+        libraryInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_LIBRARY_CREATE_INFO_EXT;
+        libraryInfo.flags = libraryParts;
+        if(!buildAll)
+        {
+            pipelineInfo.pNext = &libraryInfo;
+            pipelineInfo.flags = VK_PIPELINE_CREATE_LIBRARY_BIT_KHR | VK_PIPELINE_CREATE_RETAIN_LINK_TIME_OPTIMIZATION_INFO_BIT_EXT;
+        }
+
+        VkPipeline pipeline;
+        auto pipelineStartTime = std::chrono::high_resolution_clock::now();
+        if(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineInfo, NULL, &pipeline) != VK_SUCCESS)
         {
             std::cout << "Failed to create graphics pipeline!" << std::endl;
-            exit(1);
+            pipeline = VK_NULL_HANDLE;
         }
+        auto pipelineEndTime = std::chrono::high_resolution_clock::now();
+        std::cout << (buildAll ? "Graphics pipeline" : "Graphics pipeline library part") << " created in " << std::chrono::duration<double, std::milli>(pipelineEndTime - pipelineStartTime).count() << " ms ("
+            << (pipelineCacheLoaded ? "warm" : "cold") << " pipeline cache)" << std::endl;
 
         vkDestroyShaderModule(device, fragShaderModule, NULL);
         vkDestroyShaderModule(device, vertShaderModule, NULL);
+
+        return pipeline;
+    }
+
+    void createPipelineCache()
+    {
+        VkPhysicalDeviceProperties deviceProperties;
+        vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
+
+        //Only seed the cache if the file was written by this exact device and driver; otherwise start empty
+        std::vector<char> cacheData;
+        std::ifstream file(PIPELINE_CACHE_PATH, std::ios::ate | std::ios::binary);
+        if(file.is_open())
+        {
+            size_t fileSize = (size_t)file.tellg();
+            PipelineCacheFileHeader header = {};
+            file.seekg(0);
+            if(fileSize >= sizeof(header) && file.read((char*)&header, sizeof(header)) &&
+                header.magic == PIPELINE_CACHE_MAGIC &&
+                header.headerSize == sizeof(header) &&
+                header.vendorID == deviceProperties.vendorID &&
+                header.deviceID == deviceProperties.deviceID &&
+                header.driverVersion == deviceProperties.driverVersion &&
+                memcmp(header.pipelineCacheUUID, deviceProperties.pipelineCacheUUID, VK_UUID_SIZE) == 0 &&
+                header.dataSize == fileSize - sizeof(header))
+            {
+                cacheData.resize((size_t)header.dataSize);
+                if(!file.read(cacheData.data(), cacheData.size()))
+                    cacheData.clear();
+            }
+            else
+                std::cout << "Ignoring stale pipeline cache " << PIPELINE_CACHE_PATH << std::endl;
+            file.close();
+        }
+
+        VkPipelineCacheCreateInfo cacheInfo = {};
+        cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+        cacheInfo.initialDataSize = cacheData.size();
+        cacheInfo.pInitialData = cacheData.empty() ? NULL : cacheData.data();
+
+        if(vkCreatePipelineCache(device, &cacheInfo, NULL, &pipelineCache) != VK_SUCCESS)
+        {
+            //Drivers may still reject data that passed our checks; an empty cache is always fine
+            cacheInfo.initialDataSize = 0;
+            cacheInfo.pInitialData = NULL;
+            cacheData.clear();
+            if(vkCreatePipelineCache(device, &cacheInfo, NULL, &pipelineCache) != VK_SUCCESS)
+            {
+                std::cout << "Failed to create pipeline cache" << std::endl;
+                exit(1);
+            }
+        }
+
+        pipelineCacheLoaded = !cacheData.empty();
+        std::cout << "Pipeline cache: " << (pipelineCacheLoaded ? "loaded " : "starting empty, ") << cacheData.size() << " bytes" << std::endl;
+    }
+
+    void savePipelineCache()
+    {
+        size_t dataSize = 0;
+        if(vkGetPipelineCacheData(device, pipelineCache, &dataSize, NULL) != VK_SUCCESS || dataSize == 0)
+            return;
+        std::vector<char> cacheData(dataSize);
+        if(vkGetPipelineCacheData(device, pipelineCache, &dataSize, cacheData.data()) != VK_SUCCESS)
+            return;
+
+        VkPhysicalDeviceProperties deviceProperties;
+        vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
+
+        PipelineCacheFileHeader header = {};
+        header.magic = PIPELINE_CACHE_MAGIC;
+        header.headerSize = sizeof(header);
+        header.vendorID = deviceProperties.vendorID;
+        header.deviceID = deviceProperties.deviceID;
+        header.driverVersion = deviceProperties.driverVersion;
+        memcpy(header.pipelineCacheUUID, deviceProperties.pipelineCacheUUID, VK_UUID_SIZE);
+        header.dataSize = dataSize;
+
+        //Write to a temporary file first so a crash mid-write can't leave a truncated cache behind
+        std::string tempPath = std::string(PIPELINE_CACHE_PATH) + ".tmp";
+        std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+        if(!file.is_open())
+        {
+            std::cout << "Failed to write pipeline cache " << tempPath << std::endl;
+            return;
+        }
+        file.write((const char*)&header, sizeof(header));
+        file.write(cacheData.data(), dataSize);
+        file.close();
+        if(!file)
+        {
+            std::remove(tempPath.c_str());
+            return;
+        }
+
+        //Replaces the old cache in one step, so there's always a complete cache file or none
+#ifdef _WIN32
+        bool replaced = MoveFileExA(tempPath.c_str(), PIPELINE_CACHE_PATH, MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+        bool replaced = std::rename(tempPath.c_str(), PIPELINE_CACHE_PATH) == 0;
+#endif
+        if(!replaced)
+        {
+            std::cout << "Failed to replace pipeline cache " << PIPELINE_CACHE_PATH << std::endl;
+            std::remove(tempPath.c_str());
+        }
+    }
+
+    //The embedded SPIR-V unless hot reload has overridden it. codeSize in bytes.
+    static void getShaderCode(uint32_t shader, const ShaderOverrides& overrides, const uint32_t*& code, size_t& codeSize)
+    {
+        if(overrides[shader])
+        {
+            code = overrides[shader]->data();
+            codeSize = overrides[shader]->size() * sizeof(uint32_t);
+        }
+        else
+        {
+            code = embeddedShaders[shader].code;
+            codeSize = embeddedShaders[shader].codeSize;
+        }
     }
 
-    VkShaderModule createShaderModule(const std::vector<char>& code)
+    //Combined interface of a vertex and fragment shader
+    static bool reflectShaders(uint32_t vertShader, uint32_t fragShader, const ShaderOverrides& overrides, ShaderReflection& reflection)
+    {
+        reflection = ShaderReflection();
+        const uint32_t shaders[] = { vertShader, fragShader };
+        for(uint32_t shader : shaders)
+        {
+            const uint32_t* code;
+            size_t codeSize;
+            getShaderCode(shader, overrides, code, codeSize);
+
+            ShaderReflection stage;
+            if(!reflectSpirv(code, codeSize, stage) || !mergeShaderReflection(stage, reflection))
+                return false;
+        }
+
+        //SPIR-V can't say a uniform buffer is dynamic; per-draw ones always are, so draws can share a set
+        for(ReflectedBinding& binding : reflection.bindings)
+        {
+            if(binding.set == DESCRIPTOR_SET_DRAW && binding.descriptorType == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER)
+                binding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+        }
+        return true;
+    }
+
+    //Returns VK_NULL_HANDLE on failure
+    VkShaderModule tryCreateShaderModule(uint32_t shader, const ShaderOverrides& overrides)
     {
         VkShaderModuleCreateInfo createInfo = {};
         createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-        createInfo.codeSize = code.size();
-        createInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
+        getShaderCode(shader, overrides, createInfo.pCode, createInfo.codeSize);
 
         VkShaderModule shaderModule;
         if(vkCreateShaderModule(device, &createInfo, NULL, &shaderModule) != VK_SUCCESS)
         {
             std::cout << "Failed to create shader module" << std::endl;
-            exit(1);
+            return VK_NULL_HANDLE;
         }
         return shaderModule;
     }
 
+    void startShaderWatcher()
+    {
+        std::vector<std::string> fileNames(shaderFileNames, shaderFileNames + SHADER_COUNT);
+        if(!shaderWatcher.start(SHADER_DIRECTORY, fileNames))
+            std::cout << "Unable to watch " << SHADER_DIRECTORY << ", shader hot reload disabled" << std::endl;
+    }
+
+    //Shader hot reload. When a watched .spv changes, it's loaded over the embedded SPIR-V and every pipeline using it is rebuilt on the worker pool.
+    //Once they've all finished, they're swapped in between frames and the old ones are destroyed after the GPU
+    //is done with them, so rendering never has to stop and wait for the device.
+    void processShaderReloads()
+    {
+        if(pendingReloads.empty())
+        {
+            std::vector<std::string> changedFiles = shaderWatcher.takeChangedFiles();
+            if(changedFiles.empty())
+                return;
+
+            {
+                std::lock_guard<std::mutex> lock(shaderOverridesMutex);
+                pendingShaderOverrides = shaderOverrides;
+            }
+
+            std::set<uint32_t> changedShaders;
+            for(const std::string& fileName : changedFiles)
+            {
+                for(uint32_t i = 0; i < SHADER_COUNT; i++)
+                {
+                    if(fileName != shaderFileNames[i])
+                        continue;
+
+                    auto code = std::make_shared<std::vector<uint32_t>>();
+                    if(!tryReadSpirvFile(std::string(SHADER_DIRECTORY) + fileName, *code))
+                    {
+                        std::cout << "Shader reload failed, keeping the old pipelines" << std::endl;
+                        return;
+                    }
+                    pendingShaderOverrides[i] = code;
+                    changedShaders.insert(i);
+                }
+            }
+
+            const ShaderOverrides& overrides = pendingShaderOverrides;
+            for(const PipelineDescription& description : pipelineRegistry.getDescriptions(false))
+            {
+                if(changedShaders.count(description.vertShader) || changedShaders.count(description.fragShader))
+                {
+                    std::shared_future<VkPipeline> pipeline = pipelineCompilePool.submit([this, description, overrides]() { return tryBuildGraphicsPipeline(description, overrides); }).share();
+                    pendingReloads.push_back(std::make_pair(description, pipeline));
+                }
+            }
+            std::cout << "Shader change detected, rebuilding " << pendingReloads.size() << " pipeline(s)" << std::endl;
+            return;
+        }
+
+        for(const auto& reload : pendingReloads)
+        {
+            if(reload.second.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+                return;
+        }
+
+        //Swap in all or nothing, so pipelines never end up with a mix of old and new shaders
+        bool failed = false;
+        for(const auto& reload : pendingReloads)
+            failed = failed || reload.second.get() == VK_NULL_HANDLE;
+
+        if(failed)
+        {
+            //The new pipelines were never used, so they can go right away
+            for(const auto& reload : pendingReloads)
+                vkDestroyPipeline(device, reload.second.get(), NULL);
+            std::cout << "Shader reload failed, keeping the old pipelines" << std::endl;
+        }
+        else
+        {
+            for(const auto& reload : pendingReloads)
+            {
+                VkPipeline newPipeline = reload.second.get();
+                VkPipeline oldPipeline = pipelineRegistry.replace(reload.first, newPipeline);
+                replacePipelineHandle(oldPipeline, newPipeline);
+                VkDevice logicalDevice = device;
+                deferDestroy([logicalDevice, oldPipeline]() { vkDestroyPipeline(logicalDevice, oldPipeline, NULL); });
+            }
+            {
+                std::lock_guard<std::mutex> lock(shaderOverridesMutex);
+                shaderOverrides = pendingShaderOverrides;
+            }
+            commandBufferDirty.assign(commandBuffers.size(), true);
+            std::cout << "Reloaded " << pendingReloads.size() << " pipeline(s)" << std::endl;
+        }
+        pendingReloads.clear();
+    }
+
+    //Reload results are built against the current render pass; drop them if it's about to go away
+    void discardPendingReloads()
+    {
+        for(const auto& reload : pendingReloads)
+            vkDestroyPipeline(device, reload.second.get(), NULL);
+        pendingReloads.clear();
+    }
+
     void createImageViews()
     {
         swapChainImageViews.resize(swapChainImages.size());
@@ -1336,15 +3006,26 @@ private:
 
     void recreateSwapChain()
     {
+        auto startTime = std::chrono::high_resolution_clock::now();
+        VkFormat oldImageFormat = swapChainImageFormat;
+
         cleanupSwapChain();
 
         createSwapChain();
         createImageViews();
-        createRenderPass();
-        createGraphicsPipeline();
+        //Viewport and scissor are dynamic, so the render pass and pipeline only need rebuilding if the surface format changed
+        if(swapChainImageFormat != oldImageFormat)
+        {
+            cleanupPipeline();
+            createRenderPass();
+            createGraphicsPipeline();
+        }
         createDepthResources();
         createFramebuffers();
         createCommandBuffers();
+
+        auto endTime = std::chrono::high_resolution_clock::now();
+        std::cout << "Swapchain recreated in " << std::chrono::duration<double, std::milli>(endTime - startTime).count() << " ms" << std::endl;
     }
 
     void createSwapChain()
@@ -1444,14 +3125,89 @@ private:
         VkPhysicalDeviceFeatures deviceFeatures = {};
         deviceFeatures.samplerAnisotropy = VK_TRUE; //Config option: Not require this
 
+        //Optional extensions
+        std::vector<const char*> enabledExtensions = deviceExtensions;
+        VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT pipelineLibraryFeatures = {};
+        pipelineLibraryFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_FEATURES_EXT;
+        graphicsPipelineLibrarySupported = checkGraphicsPipelineLibrarySupport(physicalDevice);
+        if(graphicsPipelineLibrarySupported)
+        {
+            enabledExtensions.push_back(VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME);
+            enabledExtensions.push_back(VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME);
+            pipelineLibraryFeatures.graphicsPipelineLibrary = VK_TRUE;
+        }
+        std::cout << "Graphics pipeline library " << (graphicsPipelineLibrarySupported ? "supported, fast-linking pipelines" : "not supported, using monolithic pipelines") << std::endl;
+
+        //Core in Vulkan 1.2; an extension at the version we target
+        VkPhysicalDeviceDescriptorIndexingFeaturesEXT descriptorIndexingFeatures = {};
+        descriptorIndexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+        bindlessTextureCapacity = checkDescriptorIndexingSupport(physicalDevice);
+        bindlessTexturesSupported = (bindlessTextureCapacity > 0);
+        if(bindlessTexturesSupported)
+        {
+            enabledExtensions.push_back(VK_KHR_MAINTENANCE3_EXTENSION_NAME);
+            enabledExtensions.push_back(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME);
+            descriptorIndexingFeatures.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+            descriptorIndexingFeatures.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+            descriptorIndexingFeatures.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+            descriptorIndexingFeatures.descriptorBindingPartiallyBound = VK_TRUE;
+            descriptorIndexingFeatures.descriptorBindingVariableDescriptorCount = VK_TRUE;
+            descriptorIndexingFeatures.runtimeDescriptorArray = VK_TRUE;
+            std::cout << "Descriptor indexing supported, using bindless textures (up to " << bindlessTextureCapacity << ")" << std::endl;
+        }
+        else
+            std::cout << "Descriptor indexing not supported, binding a descriptor set per material" << std::endl;
+
+        //Bindless materials never change set, so pushing only helps without them
+        pushDescriptorsSupported = !bindlessTexturesSupported && hasDeviceExtensions(physicalDevice, { VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME });
+        if(pushDescriptorsSupported)
+        {
+            enabledExtensions.push_back(VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME);
+            std::cout << "Push descriptors supported, pushing material textures while recording" << std::endl;
+        }
+        else if(!bindlessTexturesSupported)
+            std::cout << "Push descriptors not supported, using cached material descriptor sets" << std::endl;
+
+        //One indirect draw per instance, each selecting its instance data with firstInstance
+        if(options.gpuCulling && !checkGpuCullingSupport(physicalDevice))
+        {
+            std::cout << "Multi-draw indirect not supported, GPU culling disabled" << std::endl;
+            options.gpuCulling = false;
+        }
+        if(options.gpuCulling)
+        {
+            deviceFeatures.multiDrawIndirect = VK_TRUE;
+            deviceFeatures.drawIndirectFirstInstance = VK_TRUE;
+
+            //Core in Vulkan 1.2; an extension at the version we target
+            drawIndirectCountSupported = hasDeviceExtensions(physicalDevice, { VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME });
+            if(drawIndirectCountSupported)
+                enabledExtensions.push_back(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+            std::cout << "GPU culling enabled, " << (drawIndirectCountSupported ? "drawing only visible instances with an indirect count" : "culled instances drawn with no instances") << std::endl;
+        }
+
+        //Chain whichever optional feature structs are in use
+        void* featureChain = NULL;
+        if(bindlessTexturesSupported)
+        {
+            descriptorIndexingFeatures.pNext = featureChain;
+            featureChain = &descriptorIndexingFeatures;
+        }
+        if(graphicsPipelineLibrarySupported)
+        {
+            pipelineLibraryFeatures.pNext = featureChain;
+            featureChain = &pipelineLibraryFeatures;
+        }
+
         VkDeviceCreateInfo createInfo = {};
         createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
         createInfo.pQueueCreateInfos = &queueCreateInfo;
         createInfo.queueCreateInfoCount = queueCreateInfos.size();
         createInfo.pQueueCreateInfos = queueCreateInfos.data();
         createInfo.pEnabledFeatures = &deviceFeatures;
-        createInfo.enabledExtensionCount = deviceExtensions.size();
-        createInfo.ppEnabledExtensionNames = deviceExtensions.data();
+        createInfo.pNext = featureChain;
+        createInfo.enabledExtensionCount = enabledExtensions.size();
+        createInfo.ppEnabledExtensionNames = enabledExtensions.data();
 #ifdef ENABLE_VALIDATION_LAYERS
         createInfo.enabledLayerCount = validationLayers.size();
         createInfo.ppEnabledLayerNames = validationLayers.data();
@@ -1467,6 +3223,26 @@ private:
 
         vkGetDeviceQueue(device, indices.graphicsFamily, 0, &graphicsQueue);
         vkGetDeviceQueue(device, indices.presentFamily, 0, &presentQueue);
+
+        //Extension commands aren't exported by the loader
+        if(pushDescriptorsSupported)
+        {
+            cmdPushDescriptorSet = (PFN_vkCmdPushDescriptorSetKHR)vkGetDeviceProcAddr(device, "vkCmdPushDescriptorSetKHR");
+            if(cmdPushDescriptorSet == NULL)
+            {
+                std::cout << "Failed to load vkCmdPushDescriptorSetKHR" << std::endl;
+                exit(1);
+            }
+        }
+        if(drawIndirectCountSupported)
+        {
+            cmdDrawIndexedIndirectCount = (PFN_vkCmdDrawIndexedIndirectCountKHR)vkGetDeviceProcAddr(device, "vkCmdDrawIndexedIndirectCountKHR");
+            if(cmdDrawIndexedIndirectCount == NULL)
+            {
+                std::cout << "Failed to load vkCmdDrawIndexedIndirectCountKHR" << std::endl;
+                exit(1);
+            }
+        }
     }
 
     void pickPhysicalDevice()
@@ -1500,6 +3276,10 @@ private:
             std::cout << "Failed to find a suitable GPU" << std::endl;
             exit(1);
         }
+
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+        maxSamplerAnisotropy = properties.limits.maxSamplerAnisotropy;
     }
 
     int rateDeviceSuitability(VkPhysicalDevice device)
@@ -1591,7 +3371,85 @@ private:
         }
     }
 
-    bool checkDeviceExtensionSupport(VkPhysicalDevice device)
+    //Needs both extensions, the feature, and fast linking; without fast linking, libraries don't save any time
+    bool checkGraphicsPipelineLibrarySupport(VkPhysicalDevice device)
+    {
+        if(!hasDeviceExtensions(device, { VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME, VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME }))
+            return false;
+
+        VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT pipelineLibraryFeatures = {};
+        pipelineLibraryFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_FEATURES_EXT;
+        VkPhysicalDeviceFeatures2 features = {};
+        features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features.pNext = &pipelineLibraryFeatures;
+        vkGetPhysicalDeviceFeatures2(device, &features);
+
+        VkPhysicalDeviceGraphicsPipelineLibraryPropertiesEXT pipelineLibraryProperties = {};
+        pipelineLibraryProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_PROPERTIES_EXT;
+        VkPhysicalDeviceProperties2 properties = {};
+        properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+        properties.pNext = &pipelineLibraryProperties;
+        vkGetPhysicalDeviceProperties2(device, &properties);
+
+        return pipelineLibraryFeatures.graphicsPipelineLibrary && pipelineLibraryProperties.graphicsPipelineLibraryFastLinking;
+    }
+
+    //The cull pass writes one indirect draw per instance, and they're all submitted with one multi-draw
+    bool checkGpuCullingSupport(VkPhysicalDevice device)
+    {
+        VkPhysicalDeviceFeatures features;
+        vkGetPhysicalDeviceFeatures(device, &features);
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(device, &properties);
+
+        //The cull pass is recorded into the graphics command buffers
+        uint32_t queueFamilyCount = 0;
+        vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, NULL);
+        std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+        vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, queueFamilies.data());
+        int graphicsFamily = findQueueFamilies(device).graphicsFamily;
+
+        return features.multiDrawIndirect && features.drawIndirectFirstInstance && properties.limits.maxDrawIndirectCount >= MAX_INSTANCES &&
+            graphicsFamily >= 0 && (queueFamilies[graphicsFamily].queueFlags & VK_QUEUE_COMPUTE_BIT);
+    }
+
+    //Bindless textures need a runtime-sized array of sampled images, indexed per draw, that can be partially
+    //written and updated after it's bound. Returns how many textures it can hold, or 0 if unsupported.
+    uint32_t checkDescriptorIndexingSupport(VkPhysicalDevice device)
+    {
+        if(!hasDeviceExtensions(device, { VK_KHR_MAINTENANCE3_EXTENSION_NAME, VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME }))
+            return 0;
+
+        VkPhysicalDeviceDescriptorIndexingFeaturesEXT descriptorIndexingFeatures = {};
+        descriptorIndexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+        VkPhysicalDeviceFeatures2 features = {};
+        features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features.pNext = &descriptorIndexingFeatures;
+        vkGetPhysicalDeviceFeatures2(device, &features);
+
+        if(!descriptorIndexingFeatures.shaderSampledImageArrayNonUniformIndexing ||
+            !descriptorIndexingFeatures.descriptorBindingSampledImageUpdateAfterBind ||
+            !descriptorIndexingFeatures.descriptorBindingUpdateUnusedWhilePending ||
+            !descriptorIndexingFeatures.descriptorBindingPartiallyBound ||
+            !descriptorIndexingFeatures.descriptorBindingVariableDescriptorCount ||
+            !descriptorIndexingFeatures.runtimeDescriptorArray)
+            return 0;
+
+        VkPhysicalDeviceDescriptorIndexingPropertiesEXT descriptorIndexingProperties = {};
+        descriptorIndexingProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES_EXT;
+        VkPhysicalDeviceProperties2 properties = {};
+        properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+        properties.pNext = &descriptorIndexingProperties;
+        vkGetPhysicalDeviceProperties2(device, &properties);
+
+        uint32_t capacity = MAX_BINDLESS_TEXTURES;
+        capacity = std::min(capacity, descriptorIndexingProperties.maxPerStageDescriptorUpdateAfterBindSampledImages);
+        capacity = std::min(capacity, descriptorIndexingProperties.maxDescriptorSetUpdateAfterBindSampledImages);
+        capacity = std::min(capacity, 1u << BINDLESS_TEXTURE_INDEX_BITS);
+        return capacity;
+    }
+
+    bool hasDeviceExtensions(VkPhysicalDevice device, std::set<std::string> requiredExtensions)
     {
         uint32_t extensionCount;
         vkEnumerateDeviceExtensionProperties(device, NULL, &extensionCount, NULL);
@@ -1599,14 +3457,17 @@ private:
         std::vector<VkExtensionProperties> availableExtensions(extensionCount);
         vkEnumerateDeviceExtensionProperties(device, NULL, &extensionCount, availableExtensions.data());
 
-        std::set<std::string> requiredExtensions(deviceExtensions.begin(), deviceExtensions.end());
-
         for(const auto& extension : availableExtensions)
             requiredExtensions.erase(extension.extensionName);
 
         return requiredExtensions.empty();
     }
 
+    bool checkDeviceExtensionSupport(VkPhysicalDevice device)
+    {
+        return hasDeviceExtensions(device, std::set<std::string>(deviceExtensions.begin(), deviceExtensions.end()));
+    }
+
     SwapChainSupportDetails querySwapChainSupport(VkPhysicalDevice device)
     {
         SwapChainSupportDetails details = {};
@@ -1682,6 +3543,10 @@ private:
                     resizeWindow(event.window.data1, event.window.data2);
             }
 
+            checkPendingPipelines();
+            processOptimizedPipelines();
+            processShaderReloads();
+
             //Update uniforms
             updateUniformBuffer();
 
@@ -1690,7 +3555,80 @@ private:
         }
     }
 
-    //TODO: Look into push constants instead for a more efficient way to pass frequently-changing values to the shader
+    //Average frame time at increasing instance counts. Frames are paced by presentation, so with FIFO (no mailbox
+    //support) anything under the refresh interval just reads as the refresh interval.
+    void runInstanceBenchmark()
+    {
+        const uint32_t instanceCounts[] = { 1000, 10000, 100000 };
+        const uint32_t warmupFrames = 10;
+        std::cout << "Instance benchmark: " << INSTANCE_BENCHMARK_FRAMES << " frames per count, one draw call each" << std::endl;
+        for(uint32_t count : instanceCounts)
+        {
+            setInstances(createInstanceGrid(std::min(count, (uint32_t)MAX_INSTANCES)));
+
+            std::chrono::high_resolution_clock::time_point startTime;
+            for(uint32_t frame = 0; frame < warmupFrames + INSTANCE_BENCHMARK_FRAMES; frame++)
+            {
+                if(frame == warmupFrames)
+                    startTime = std::chrono::high_resolution_clock::now();
+
+                SDL_Event event;
+                while(SDL_PollEvent(&event))
+                {
+                    if(event.type == SDL_QUIT || (event.type == SDL_KEYDOWN && event.key.keysym.scancode == SDL_SCANCODE_ESCAPE))
+                        return;
+                    if(event.type == SDL_WINDOWEVENT && event.window.event == SDL_WINDOWEVENT_SIZE_CHANGED)
+                        resizeWindow(event.window.data1, event.window.data2);
+                }
+                updateUniformBuffer();
+                drawFrame();
+            }
+            vkDeviceWaitIdle(device);
+            auto endTime = std::chrono::high_resolution_clock::now();
+
+            double frameMs = std::chrono::duration<double, std::milli>(endTime - startTime).count() / INSTANCE_BENCHMARK_FRAMES;
+            std::cout << "  " << instanceCount << " instances: " << frameMs << " ms/frame, "
+                << (instanceCount / frameMs) / 1000.0 << " M instances/s" << std::endl;
+        }
+    }
+
+    //CPU time to record a frame's command buffer on increasing numbers of threads. One thread is the usual inline
+    //recording on this thread, with no secondary buffers. Nothing is submitted; it only measures recording.
+    void runRecordBenchmark()
+    {
+        vkDeviceWaitIdle(device);
+        std::vector<size_t> threadCounts;
+        for(size_t threads = 1; threads < recordPool.getThreadCount(); threads *= 2)
+            threadCounts.push_back(threads);
+        threadCounts.push_back(recordPool.getThreadCount());
+
+        const uint32_t warmupIterations = 2;
+        std::cout << "Record benchmark: " << visibleObjects.size() << " draws, " << RECORD_BENCHMARK_ITERATIONS << " recordings each" << std::endl;
+        for(size_t threadCount : threadCounts)
+        {
+            ThreadPool threadPool(threadCount);
+
+            std::chrono::high_resolution_clock::time_point startTime;
+            for(uint32_t iteration = 0; iteration < warmupIterations + RECORD_BENCHMARK_ITERATIONS; iteration++)
+            {
+                if(iteration == warmupIterations)
+                    startTime = std::chrono::high_resolution_clock::now();
+                if(options.perFrameRecording)
+                {
+                    vkResetCommandPool(device, frameCommandPools[0], 0);
+                    transientSetAllocators[currentFrame].reset();
+                }
+                recordCommandBuffer(0, 0, threadPool, threadCount);
+            }
+            auto endTime = std::chrono::high_resolution_clock::now();
+
+            double recordMs = std::chrono::duration<double, std::milli>(endTime - startTime).count() / RECORD_BENCHMARK_ITERATIONS;
+            std::cout << "  " << threadCount << " thread(s): " << recordMs << " ms/frame, " << visibleObjects.size() / recordMs << " draws/ms" << std::endl;
+        }
+        commandBufferDirty.assign(commandBuffers.size(), true);
+    }
+
+    //Per-frame values only; per-object transforms are in objectUniformBuffer (see sceneObjects)
     void updateUniformBuffer()
     {
         //Get time in seconds since program start
@@ -1698,10 +3636,13 @@ private:
 
         //Rotate view around center
         UniformBufferObject ubo = {};
-        ubo.model = glm::rotate(glm::mat4(1.0f), time * glm::radians(90.0f), glm::vec3(0.0f, 0.0f, 1.0f));
         ubo.view = glm::lookAt(glm::vec3(2.0f, 2.0f, 2.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+        ubo.view = glm::rotate(ubo.view, time * glm::radians(90.0f), glm::vec3(0.0f, 0.0f, 1.0f));
         ubo.proj = glm::perspective(glm::radians(45.0f), swapChainExtent.width / (float)swapChainExtent.height, 0.1f, 10.0f);
         ubo.proj[1][1] *= -1; //Flip y
+        glm::mat4 viewProj = ubo.proj * ubo.view;
+        cameraFrustum = extractFrustumPlanes(&viewProj[0][0]);
+        memcpy(ubo.frustumPlanes, cameraFrustum.planes, sizeof(ubo.frustumPlanes));
 
         //Copy memory
         void* data;
@@ -1717,9 +3658,15 @@ private:
 
     void drawFrame()
     {
+        //Wait until the GPU has finished the last frame that used this frame's sync objects
+        vkWaitForFences(device, 1, &inFlightFences[currentFrame], VK_TRUE, std::numeric_limits<uint64_t>::max());
+        flushDeletionQueue(false);
+        transientSetAllocators[currentFrame].reset();
+        descriptorSetCache.beginFrame(frameNumber);
+
         //Get a new image from the swapchain
         uint32_t imageIndex;
-        VkResult result = vkAcquireNextImageKHR(device, swapChain, std::numeric_limits<uint64_t>::max(), imageAvailableSemaphore, VK_NULL_HANDLE, &imageIndex);
+        VkResult result = vkAcquireNextImageKHR(device, swapChain, std::numeric_limits<uint64_t>::max(), imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &imageIndex);
 
         if(result == VK_ERROR_OUT_OF_DATE_KHR)
         {
@@ -1733,22 +3680,54 @@ private:
             exit(1);
         }
 
+        //The swapchain can hand back images out of order, so also wait on whichever frame last used this image
+        if(imagesInFlight[imageIndex] != VK_NULL_HANDLE)
+            vkWaitForFences(device, 1, &imagesInFlight[imageIndex], VK_TRUE, std::numeric_limits<uint64_t>::max());
+        imagesInFlight[imageIndex] = inFlightFences[currentFrame];
+
+        size_t slot = options.perFrameRecording ? currentFrame : imageIndex;
+        if(options.perFrameRecording)
+        {
+            //This frame's last submit has finished, so its pools can be reset and the whole frame recorded from
+            //scratch, picking up whatever changed in the scene since
+            vkResetCommandPool(device, frameCommandPools[slot], 0);
+            cullSceneObjects();
+            recordCommandBuffer(slot, imageIndex);
+        }
+        else
+        {
+            //Evicted descriptor sets get rewritten with other contents, so anything recorded before an eviction is stale
+            if(descriptorSetCache.getEvictionCount() != recordedCacheEvictions)
+            {
+                commandBufferDirty.assign(commandBuffers.size(), true);
+                recordedCacheEvictions = descriptorSetCache.getEvictionCount();
+            }
+
+            //Now that nothing is using it, pick up any pipeline or descriptor set changes
+            if(commandBufferDirty[imageIndex])
+            {
+                recordCommandBuffer(slot, imageIndex);
+                commandBufferDirty[imageIndex] = false;
+            }
+        }
+
         //Submit the command buffer
         VkSubmitInfo submitInfo = {};
         submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 
-        VkSemaphore waitSemaphores[] = { imageAvailableSemaphore };
+        VkSemaphore waitSemaphores[] = { imageAvailableSemaphores[currentFrame] };
         VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
         submitInfo.waitSemaphoreCount = 1;
         submitInfo.pWaitSemaphores = waitSemaphores;
         submitInfo.pWaitDstStageMask = waitStages;
         submitInfo.commandBufferCount = 1;
-        submitInfo.pCommandBuffers = &commandBuffers[imageIndex];
-        VkSemaphore signalSemaphores[] = { renderFinishedSemaphore };
+        submitInfo.pCommandBuffers = &commandBuffers[slot];
+        VkSemaphore signalSemaphores[] = { renderFinishedSemaphores[currentFrame] };
         submitInfo.signalSemaphoreCount = 1;
         submitInfo.pSignalSemaphores = signalSemaphores;
 
-        if(vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS)
+        vkResetFences(device, 1, &inFlightFences[currentFrame]);
+        if(vkQueueSubmit(graphicsQueue, 1, &submitInfo, inFlightFences[currentFrame]) != VK_SUCCESS)
         {
             std::cout << "Failed to submit draw command buffer" << std::endl;
             exit(1);
@@ -1768,6 +3747,9 @@ private:
 
         result = vkQueuePresentKHR(presentQueue, &presentInfo);
 
+        currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+        frameNumber++;
+
         //Recreate swapchain if needed or suboptimal
         if(result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR)
             recreateSwapChain();
@@ -1776,49 +3758,106 @@ private:
             std::cout << "Failed to present swap chain image" << std::endl;
             exit(1);
         }
-
-#ifdef ENABLE_VALIDATION_LAYERS
-        //Fix memory leak in validation layer by explicitly syncronizing with GPU
-        vkQueueWaitIdle(presentQueue);
-#endif
     }
 
     void cleanupSwapChain()
     {
         //Wait until everything is done
         vkDeviceWaitIdle(device);
+        flushDeletionQueue(true);
 
         vkDestroyImageView(device, depthImageView, NULL);
         vkDestroyImage(device, depthImage, NULL);
         vkFreeMemory(device, depthImageMemory, NULL);
         for(auto framebuffer : swapChainFramebuffers)
             vkDestroyFramebuffer(device, framebuffer, NULL);
-        vkFreeCommandBuffers(device, commandPool, commandBuffers.size(), commandBuffers.data());
-        vkDestroyPipeline(device, graphicsPipeline, NULL);
-        vkDestroyPipelineLayout(device, pipelineLayout, NULL);
-        vkDestroyRenderPass(device, renderPass, NULL);
+        if(options.perFrameRecording)
+        {
+            for(VkCommandPool pool : frameCommandPools)
+                vkDestroyCommandPool(device, pool, NULL);
+            frameCommandPools.clear();
+        }
+        else
+            vkFreeCommandBuffers(device, commandPool, commandBuffers.size(), commandBuffers.data());
+        for(const std::vector<VkCommandPool>& pools : secondaryCommandPools)
+        {
+            for(VkCommandPool pool : pools)
+                vkDestroyCommandPool(device, pool, NULL);
+        }
+        secondaryCommandPools.clear();
+        secondaryCommandBuffers.clear();
         for(auto imageView : swapChainImageViews)
             vkDestroyImageView(device, imageView, NULL);
         vkDestroySwapchainKHR(device, swapChain, NULL);
     }
 
+    //Every pipeline in the registry was built against renderPass, so they go together
+    void cleanupPipeline()
+    {
+        discardPendingReloads();
+        //After destroyAll(), which waits for in-flight fast-link builds, since each of those queues an optimized link
+        //of its own; and before the library parts those links read from go away
+        pipelineRegistry.destroyAll(device);
+        discardOptimizedPipelines();
+        for(PipelineRegistry& parts : pipelineLibraryParts)
+            parts.destroyAll(device);
+        graphicsPipeline = VK_NULL_HANDLE;
+        instancedPipeline = VK_NULL_HANDLE;
+        pendingPipelines.clear();
+        vkDestroyRenderPass(device, renderPass, NULL);
+    }
+
     void cleanup()
     {
+        shaderWatcher.stop();
+        savePipelineUsageLog();
         cleanupSwapChain();
+        cleanupPipeline();
 
-        vkDestroySampler(device, textureSampler, NULL);
         vkDestroyImageView(device, textureImageView, NULL);
         vkDestroyImage(device, textureImage, NULL);
         vkFreeMemory(device, textureImageMemory, NULL);
-        vkDestroyDescriptorPool(device, descriptorPool, NULL);
-        vkDestroyDescriptorSetLayout(device, descriptorSetLayout, NULL);
+        std::cout << "Descriptor set cache: " << descriptorSetCache.getHitCount() << " hits, " << descriptorSetCache.getMissCount() << " misses, "
+            << descriptorSetCache.getEvictionCount() << " evictions, " << descriptorSetCache.getWriteCount() << " descriptor writes" << std::endl;
+        descriptorSetCache.destroyAll();
+        bindlessSetAllocator.destroyAll();
+        for(DescriptorAllocator& allocator : transientSetAllocators)
+            allocator.destroyAll();
+        layoutCache.destroyAll(device);
+        samplerCache.destroyAll(device);
         vkDestroyBuffer(device, uniformBuffer, NULL);
         vkFreeMemory(device, uniformBufferMemory, NULL);
+        vkUnmapMemory(device, objectUniformBufferMemory);
+        vkDestroyBuffer(device, objectUniformBuffer, NULL);
+        vkFreeMemory(device, objectUniformBufferMemory, NULL);
+        if(instanceBuffer != VK_NULL_HANDLE)
+        {
+            vkDestroyBuffer(device, instanceBuffer, NULL);
+            vkFreeMemory(device, instanceBufferMemory, NULL);
+        }
+        if(cullPipeline != VK_NULL_HANDLE)
+        {
+            vkDestroyPipeline(device, cullPipeline, NULL);
+            vkDestroyBuffer(device, objectBoundsBuffer, NULL);
+            vkFreeMemory(device, objectBoundsBufferMemory, NULL);
+            vkDestroyBuffer(device, drawRecordBuffer, NULL);
+            vkFreeMemory(device, drawRecordBufferMemory, NULL);
+            vkDestroyBuffer(device, drawCommandBuffer, NULL);
+            vkFreeMemory(device, drawCommandBufferMemory, NULL);
+            vkDestroyBuffer(device, drawCountBuffer, NULL);
+            vkFreeMemory(device, drawCountBufferMemory, NULL);
+        }
         vkDestroyBuffer(device, combinedBuffer, NULL);
         vkFreeMemory(device, combinedBufferMemory, NULL);
-        vkDestroySemaphore(device, renderFinishedSemaphore, NULL);
-        vkDestroySemaphore(device, imageAvailableSemaphore, NULL);
+        for(size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+        {
+            vkDestroySemaphore(device, renderFinishedSemaphores[i], NULL);
+            vkDestroySemaphore(device, imageAvailableSemaphores[i], NULL);
+            vkDestroyFence(device, inFlightFences[i], NULL);
+        }
         vkDestroyCommandPool(device, commandPool, NULL);
+        savePipelineCache();
+        vkDestroyPipelineCache(device, pipelineCache, NULL);
         vkDestroyDevice(device, NULL);
 #ifdef ENABLE_VALIDATION_LAYERS
         destroyDebugReportCallbackEXT(instance, callback, NULL);
@@ -1934,7 +3973,38 @@ int SDL_main(int argc, char* argv[])
 int main(int argc, char** argv)
 #endif
 {
+    //--instances <n> draws n copies of the mesh in one instanced draw; --instance-benchmark times a range of counts and exits;
+    //--gpu-culling frustum culls those instances on the GPU and draws them indirectly; --objects <n> draws n separate objects;
+    //--record-benchmark times command buffer recording on increasing numbers of threads and exits;
+    //--per-frame-recording re-records every frame rather than once per swapchain image
+    AppOptions options;
+    for(int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if(arg == "--instances" && i + 1 < argc)
+            options.instanceCount = (uint32_t)std::min(std::max(0, atoi(argv[++i])), MAX_INSTANCES);
+        else if(arg == "--instance-benchmark")
+            options.instanceBenchmark = true;
+        else if(arg == "--gpu-culling")
+            options.gpuCulling = true;
+        else if(arg == "--objects" && i + 1 < argc)
+            options.objectCount = (uint32_t)std::min(std::max(1, atoi(argv[++i])), MAX_SCENE_OBJECTS);
+        else if(arg == "--record-benchmark")
+            options.recordBenchmark = true;
+        else if(arg == "--per-frame-recording")
+            options.perFrameRecording = true;
+        else
+            std::cout << "Ignoring unknown argument " << arg << std::endl;
+    }
+    if(options.gpuCulling && options.instanceCount == 0 && !options.instanceBenchmark)
+    {
+        std::cout << "--gpu-culling only culls instances; ignoring it without --instances" << std::endl;
+        options.gpuCulling = false;
+    }
+    if(options.recordBenchmark)
+        options.objectCount = std::max(options.objectCount, (uint32_t)RECORD_BENCHMARK_OBJECTS);
+
     HelloTriangleApplication app;
-    app.run();
+    app.run(options);
     return EXIT_SUCCESS;
 }
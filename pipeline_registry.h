@@ -0,0 +1,236 @@
+#pragma once
+//Deduplicating cache of graphics pipelines, keyed by a compact description of the pipeline state.
+//Safe to call from any thread; each unique state is built exactly once, either on the calling thread (get)
+//or in the background on a ThreadPool (request).
+
+#include <vulkan/vulkan.h>
+#include "hash.h"
+#include "thread_pool.h"
+
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include <atomic>
+#include <chrono>
+
+enum PipelineBlendMode
+{
+    PIPELINE_BLEND_OPAQUE = 0,
+    PIPELINE_BLEND_ALPHA,
+    PIPELINE_BLEND_ADDITIVE
+};
+
+enum PipelineVertexLayout
+{
+    PIPELINE_VERTEX_LAYOUT_STANDARD = 0,  //Vertex: position, color, texCoord
+    PIPELINE_VERTEX_LAYOUT_INSTANCED      //Vertex in binding 0, plus per-instance data in binding 1
+};
+
+//Everything that makes two graphics pipelines different. All fields are 32 bits wide so there is no padding,
+//which lets the whole struct be hashed and compared as raw bytes. Always zero-initialize ( = {} ) before filling in.
+//Shaders are referred to by the application's shader IDs rather than by handle, so descriptions stay valid across runs.
+struct PipelineDescription
+{
+    uint32_t vertShader;
+    uint32_t fragShader;
+    uint32_t shaderFeatures;    //Application-defined bits, passed to the shaders as specialization constants
+    uint32_t vertexLayout;      //PipelineVertexLayout
+    uint32_t topology;          //VkPrimitiveTopology
+    uint32_t polygonMode;       //VkPolygonMode
+    uint32_t cullMode;          //VkCullModeFlags
+    uint32_t frontFace;         //VkFrontFace
+    uint32_t depthTest;
+    uint32_t depthWrite;
+    uint32_t depthCompareOp;    //VkCompareOp
+    uint32_t blendMode;         //PipelineBlendMode
+    uint32_t colorWriteMask;    //VkColorComponentFlags
+    //Render pass compatibility
+    uint32_t colorFormat;       //VkFormat
+    uint32_t depthFormat;       //VkFormat
+    uint32_t sampleCount;       //VkSampleCountFlagBits
+
+    bool operator==(const PipelineDescription& other) const
+    {
+        return memcmp(this, &other, sizeof(PipelineDescription)) == 0;
+    }
+};
+
+struct PipelineDescriptionHash
+{
+    size_t operator()(const PipelineDescription& description) const
+    {
+        return (size_t)fnv1aBytes(&description, sizeof(PipelineDescription));
+    }
+};
+
+class PipelineRegistry
+{
+public:
+    typedef std::function<VkPipeline(const PipelineDescription&)> PipelineBuilder;
+
+    //The builder is called at most once per unique description, and may be called from several threads at once
+    void setBuilder(PipelineBuilder pipelineBuilder)
+    {
+        builder = pipelineBuilder;
+    }
+
+    //Returns the pipeline for this state, building it on the calling thread if nobody has asked for it yet.
+    //If another thread is already building the same state, waits for that instead of building it twice.
+    VkPipeline get(const PipelineDescription& description)
+    {
+        std::shared_future<VkPipeline> pipeline;
+        std::promise<VkPipeline> promise;
+        if(reserve(description, pipeline, promise, true))
+            promise.set_value(builder(description));
+        return pipeline.get();
+    }
+
+    //Queues the pipeline to be built on the pool if nobody has asked for it yet. Returns immediately.
+    //Doesn't count as a use; call get() or tryGet() when actually drawing with it.
+    std::shared_future<VkPipeline> request(const PipelineDescription& description, ThreadPool& pool)
+    {
+        std::shared_future<VkPipeline> pipeline;
+        auto promise = std::make_shared<std::promise<VkPipeline>>();
+        if(reserve(description, pipeline, *promise, false))
+        {
+            pool.submit([this, promise, description]() { promise->set_value(builder(description)); });
+        }
+        return pipeline;
+    }
+
+    std::vector<std::shared_future<VkPipeline>> requestBatch(const std::vector<PipelineDescription>& descriptions, ThreadPool& pool)
+    {
+        std::vector<std::shared_future<VkPipeline>> pipelines;
+        pipelines.reserve(descriptions.size());
+        for(const PipelineDescription& description : descriptions)
+            pipelines.push_back(request(description, pool));
+        return pipelines;
+    }
+
+    //Returns VK_NULL_HANDLE if the pipeline hasn't been requested or is still compiling. Never blocks on a compile.
+    VkPipeline tryGet(const PipelineDescription& description)
+    {
+        Shard& shard = getShard(description);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto found = shard.pipelines.find(description);
+        if(found == shard.pipelines.end())
+            return VK_NULL_HANDLE;
+        found->second.used = true;
+        if(found->second.pipeline.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+            return VK_NULL_HANDLE;
+        return found->second.pipeline.get();
+    }
+
+    //Swaps in a rebuilt pipeline for an existing description and returns the old one, which the caller must destroy
+    //once the GPU is done with it. Returns VK_NULL_HANDLE (and stores nothing) if the description isn't registered.
+    VkPipeline replace(const PipelineDescription& description, VkPipeline pipeline)
+    {
+        Shard& shard = getShard(description);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto found = shard.pipelines.find(description);
+        if(found == shard.pipelines.end())
+            return VK_NULL_HANDLE;
+
+        VkPipeline oldPipeline = found->second.pipeline.get();
+        std::promise<VkPipeline> promise;
+        promise.set_value(pipeline);
+        found->second.pipeline = promise.get_future().share();
+        return oldPipeline;
+    }
+
+    //Number of unique pipelines, including any still being built
+    size_t size()
+    {
+        size_t count = 0;
+        for(Shard& shard : shards)
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            count += shard.pipelines.size();
+        }
+        return count;
+    }
+
+    uint64_t getHitCount() const { return hits; }
+    uint64_t getMissCount() const { return misses; }
+
+    //Every description requested so far. If onlyUsed, skips ones that were only compiled ahead of time and never drawn with.
+    std::vector<PipelineDescription> getDescriptions(bool onlyUsed)
+    {
+        std::vector<PipelineDescription> descriptions;
+        for(Shard& shard : shards)
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            for(const auto& entry : shard.pipelines)
+            {
+                if(!onlyUsed || entry.second.used)
+                    descriptions.push_back(entry.first);
+            }
+        }
+        return descriptions;
+    }
+
+    //Waits for any pipelines still being built, then destroys them all
+    void destroyAll(VkDevice device)
+    {
+        for(Shard& shard : shards)
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            for(auto& entry : shard.pipelines)
+                vkDestroyPipeline(device, entry.second.pipeline.get(), NULL);
+            shard.pipelines.clear();
+        }
+    }
+
+private:
+    //Sharded so threads looking up different states rarely contend on the same lock
+    static const size_t SHARD_COUNT = 16;
+
+    struct Entry
+    {
+        std::shared_future<VkPipeline> pipeline;
+        bool used;
+    };
+
+    struct Shard
+    {
+        std::mutex mutex;
+        std::unordered_map<PipelineDescription, Entry, PipelineDescriptionHash> pipelines;
+    };
+
+    Shard& getShard(const PipelineDescription& description)
+    {
+        size_t hash = PipelineDescriptionHash()(description);
+        return shards[(hash >> 8) % SHARD_COUNT];
+    }
+
+    //Finds or inserts the entry for this description. Returns true if the caller inserted it and must fulfill the promise.
+    bool reserve(const PipelineDescription& description, std::shared_future<VkPipeline>& pipeline, std::promise<VkPipeline>& promise, bool use)
+    {
+        Shard& shard = getShard(description);
+
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto found = shard.pipelines.find(description);
+        if(found != shard.pipelines.end())
+        {
+            hits++;
+            pipeline = found->second.pipeline;
+            found->second.used = found->second.used || use;
+            return false;
+        }
+
+        misses++;
+        pipeline = promise.get_future().share();
+        Entry entry = { pipeline, use };
+        shard.pipelines.emplace(description, entry);
+        return true;
+    }
+
+    PipelineBuilder builder;
+    Shard shards[SHARD_COUNT];
+    std::atomic<uint64_t> hits{ 0 };
+    std::atomic<uint64_t> misses{ 0 };
+};
@@ -0,0 +1,288 @@
+#pragma once
+//16 bits per channel PNG decoding, which the vendored stb_image 2.08 doesn't do. Built on stb_image's public zlib
+//decoder, so stb_image.h stays as upstream shipped it. Only 16-bit PNGs are handled (grey, grey+alpha, RGB and RGBA,
+//interlaced or not, with tRNS); everything else fails and should go through stb_image.
+//Include after stb_image.h. Results are native-endian and allocated with malloc(), so stbi_image_free() frees them
+//as long as STBI_FREE is left as free().
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#define PNG16_MAX_DIMENSION (1 << 24)
+
+struct Png16Header
+{
+    uint32_t width;
+    uint32_t height;
+    int channels;       //In the file: 1 grey, 2 grey+alpha, 3 RGB, 4 RGBA
+    bool interlaced;
+};
+
+inline uint32_t readBigEndian32(const unsigned char* p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+//Checks the signature and IHDR, which must come first. False if it's not a PNG or not 16 bits per channel.
+inline bool readPng16Header(const unsigned char* buffer, size_t len, Png16Header& header)
+{
+    static const unsigned char pngSignature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    if(len < 33 || memcmp(buffer, pngSignature, sizeof(pngSignature)) != 0)
+        return false;
+    const unsigned char* ihdr = buffer + 8;
+    if(readBigEndian32(ihdr) != 13 || memcmp(ihdr + 4, "IHDR", 4) != 0)
+        return false;
+
+    const unsigned char* fields = ihdr + 8;
+    header.width = readBigEndian32(fields);
+    header.height = readBigEndian32(fields + 4);
+    uint8_t bitDepth = fields[8];
+    uint8_t colorType = fields[9];
+    header.interlaced = (fields[12] == 1);
+    if(bitDepth != 16 || fields[10] != 0 || fields[11] != 0 || fields[12] > 1)
+        return false;
+    if(header.width == 0 || header.height == 0 || header.width > PNG16_MAX_DIMENSION || header.height > PNG16_MAX_DIMENSION)
+        return false;
+
+    switch(colorType)
+    {
+    case 0: header.channels = 1; break;
+    case 4: header.channels = 2; break;
+    case 2: header.channels = 3; break;
+    case 6: header.channels = 4; break;
+    default: return false;     //Palette images can't be 16-bit
+    }
+    return true;
+}
+
+inline int png16Paeth(int a, int b, int c)
+{
+    int p = a + b - c;
+    int pa = abs(p - a);
+    int pb = abs(p - b);
+    int pc = abs(p - c);
+    if(pa <= pb && pa <= pc)
+        return a;
+    return (pb <= pc) ? b : c;
+}
+
+//Undoes the per-row filters of one (sub)image. Each row of data is a filter byte followed by rowBytes of samples;
+//out gets the rows packed without the filter bytes. Returns false on an unknown filter.
+inline bool unfilterPng16(unsigned char* data, uint32_t rowBytes, uint32_t rows, int bytesPerPixel, std::vector<unsigned char>& out)
+{
+    out.resize((size_t)rowBytes * rows);
+    for(uint32_t row = 0; row < rows; row++)
+    {
+        const unsigned char* in = data + (size_t)row * (rowBytes + 1);
+        unsigned char* current = &out[(size_t)row * rowBytes];
+        const unsigned char* previous = (row > 0) ? current - rowBytes : NULL;
+        uint8_t filter = in[0];
+        in++;
+
+        for(uint32_t i = 0; i < rowBytes; i++)
+        {
+            int left = (i >= (uint32_t)bytesPerPixel) ? current[i - bytesPerPixel] : 0;
+            int up = previous ? previous[i] : 0;
+            int upLeft = (previous && i >= (uint32_t)bytesPerPixel) ? previous[i - bytesPerPixel] : 0;
+            int predicted;
+            switch(filter)
+            {
+            case 0: predicted = 0; break;
+            case 1: predicted = left; break;
+            case 2: predicted = up; break;
+            case 3: predicted = (left + up) >> 1; break;
+            case 4: predicted = png16Paeth(left, up, upLeft); break;
+            default: return false;
+            }
+            current[i] = (unsigned char)(in[i] + predicted);
+        }
+    }
+    return true;
+}
+
+//Decodes a 16-bit PNG. reqComp of 0 keeps the file's channels (plus alpha if it has tRNS), 1-4 converts to grey,
+//grey+alpha, RGB or RGBA the way stb_image does for 8-bit images. comp gets the file's channels. Returns NULL on failure.
+inline uint16_t* loadPng16FromMemory(const unsigned char* buffer, int len, int* x, int* y, int* comp, int reqComp)
+{
+    Png16Header header;
+    if(len <= 0 || reqComp < 0 || reqComp > 4 || !readPng16Header(buffer, (size_t)len, header))
+        return NULL;
+
+    //Gather the compressed data and the transparent color, if any
+    std::vector<unsigned char> compressed;
+    bool hasTransparentColor = false;
+    uint16_t transparentColor[3] = {};
+    size_t pos = 8;
+    bool ended = false;
+    while(!ended && pos + 12 <= (size_t)len)
+    {
+        uint32_t chunkLength = readBigEndian32(buffer + pos);
+        const unsigned char* type = buffer + pos + 4;
+        const unsigned char* chunkData = buffer + pos + 8;
+        if(chunkLength > (size_t)len - pos - 12)
+            return NULL;
+
+        if(memcmp(type, "IDAT", 4) == 0)
+            compressed.insert(compressed.end(), chunkData, chunkData + chunkLength);
+        else if(memcmp(type, "tRNS", 4) == 0)
+        {
+            //Only grey and RGB images can have one; a single color, one value per channel
+            if((header.channels != 1 && header.channels != 3) || chunkLength != (uint32_t)header.channels * 2)
+                return NULL;
+            for(int c = 0; c < header.channels; c++)
+                transparentColor[c] = (uint16_t)((chunkData[c * 2] << 8) | chunkData[c * 2 + 1]);
+            hasTransparentColor = true;
+        }
+        else if(memcmp(type, "IEND", 4) == 0)
+            ended = true;
+        pos += 12 + (size_t)chunkLength;
+    }
+    if(compressed.empty())
+        return NULL;
+
+    //Deflate can't expand more than about 1032:1, so a corrupt header can't make the first guess huge
+    int bytesPerPixel = header.channels * 2;
+    size_t rawSize = (size_t)header.height * (1 + (size_t)header.width * bytesPerPixel);    //Not counting interlacing's extra filter bytes
+    size_t initialSize = std::min(rawSize, std::min(compressed.size() * 1032, (size_t)INT32_MAX));
+    int inflatedLength = 0;
+    char* inflated = stbi_zlib_decode_malloc_guesssize_headerflag((const char*)compressed.data(), (int)compressed.size(), (int)initialSize, &inflatedLength, 1);
+    if(inflated == NULL)
+        return NULL;
+
+    //Every row carries at least as many samples as the image's own, so this also keeps the image buffer below
+    //what the data actually holds
+    if((size_t)inflatedLength < rawSize)
+    {
+        stbi_image_free(inflated);
+        return NULL;
+    }
+
+    //Unfilter each pass (just one without interlacing) and scatter its pixels into the full image
+    static const uint32_t passX[7] = { 0, 4, 0, 2, 0, 1, 0 };
+    static const uint32_t passY[7] = { 0, 0, 4, 0, 2, 0, 1 };
+    static const uint32_t passStepX[7] = { 8, 8, 4, 4, 2, 2, 1 };
+    static const uint32_t passStepY[7] = { 8, 8, 8, 4, 4, 2, 2 };
+    int passCount = header.interlaced ? 7 : 1;
+
+    std::vector<unsigned char> image((size_t)header.width * header.height * bytesPerPixel);
+    std::vector<unsigned char> pass;
+    size_t consumed = 0;
+    bool failed = false;
+    for(int p = 0; p < passCount && !failed; p++)
+    {
+        uint32_t originX = header.interlaced ? passX[p] : 0;
+        uint32_t originY = header.interlaced ? passY[p] : 0;
+        uint32_t stepX = header.interlaced ? passStepX[p] : 1;
+        uint32_t stepY = header.interlaced ? passStepY[p] : 1;
+        uint32_t passWidth = (header.width > originX) ? (header.width - originX + stepX - 1) / stepX : 0;
+        uint32_t passHeight = (header.height > originY) ? (header.height - originY + stepY - 1) / stepY : 0;
+        if(passWidth == 0 || passHeight == 0)
+            continue;
+
+        uint32_t rowBytes = passWidth * bytesPerPixel;
+        size_t passSize = (size_t)passHeight * (rowBytes + 1);
+        if(consumed + passSize > (size_t)inflatedLength || !unfilterPng16((unsigned char*)inflated + consumed, rowBytes, passHeight, bytesPerPixel, pass))
+        {
+            failed = true;
+            break;
+        }
+        consumed += passSize;
+
+        for(uint32_t row = 0; row < passHeight; row++)
+        {
+            for(uint32_t column = 0; column < passWidth; column++)
+            {
+                size_t dst = ((size_t)(originY + row * stepY) * header.width + originX + column * stepX) * bytesPerPixel;
+                memcpy(&image[dst], &pass[((size_t)row * passWidth + column) * bytesPerPixel], bytesPerPixel);
+            }
+        }
+    }
+    stbi_image_free(inflated);
+    if(failed)
+        return NULL;
+
+    //Big-endian samples to native ones, converting channels on the way
+    int fileChannels = header.channels + (hasTransparentColor ? 1 : 0);
+    int outChannels = (reqComp != 0) ? reqComp : fileChannels;
+    size_t pixelCount = (size_t)header.width * header.height;
+    uint16_t* result = (uint16_t*)malloc(pixelCount * outChannels * sizeof(uint16_t));
+    if(result == NULL)
+        return NULL;
+
+    bool color = (header.channels >= 3);
+    bool fileAlpha = (header.channels == 2 || header.channels == 4);
+    for(size_t i = 0; i < pixelCount; i++)
+    {
+        const unsigned char* in = &image[i * bytesPerPixel];
+        uint16_t samples[4];
+        for(int c = 0; c < header.channels; c++)
+            samples[c] = (uint16_t)((in[c * 2] << 8) | in[c * 2 + 1]);
+
+        uint16_t r = samples[0];
+        uint16_t g = color ? samples[1] : samples[0];
+        uint16_t b = color ? samples[2] : samples[0];
+        uint16_t alpha = fileAlpha ? samples[header.channels - 1] : 0xFFFF;
+        if(hasTransparentColor && memcmp(samples, transparentColor, header.channels * sizeof(uint16_t)) == 0)
+            alpha = 0;
+        uint16_t grey = color ? (uint16_t)((r * 77 + g * 150 + b * 29) >> 8) : r;    //Same weights as stb_image
+
+        uint16_t* out = result + i * outChannels;
+        switch(outChannels)
+        {
+        case 1: out[0] = grey; break;
+        case 2: out[0] = grey; out[1] = alpha; break;
+        case 3: out[0] = r; out[1] = g; out[2] = b; break;
+        case 4: out[0] = r; out[1] = g; out[2] = b; out[3] = alpha; break;
+        }
+    }
+
+    *x = (int)header.width;
+    *y = (int)header.height;
+    if(comp != NULL)
+        *comp = fileChannels;
+    return result;
+}
+
+inline bool readWholePng16File(const char* filename, std::vector<unsigned char>& contents)
+{
+    FILE* file = fopen(filename, "rb");
+    if(file == NULL)
+        return false;
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    contents.resize(size > 0 ? (size_t)size : 0);
+    bool read = size > 0 && fread(contents.data(), 1, contents.size(), file) == contents.size();
+    fclose(file);
+    return read;
+}
+
+inline uint16_t* loadPng16(const char* filename, int* x, int* y, int* comp, int reqComp)
+{
+    std::vector<unsigned char> contents;
+    if(!readWholePng16File(filename, contents) || contents.size() > (size_t)INT32_MAX)
+        return NULL;
+    return loadPng16FromMemory(contents.data(), (int)contents.size(), x, y, comp, reqComp);
+}
+
+inline bool isPng16FromMemory(const unsigned char* buffer, int len)
+{
+    Png16Header header;
+    return len > 0 && readPng16Header(buffer, (size_t)len, header);
+}
+
+//Only reads as far as the header
+inline bool isPng16(const char* filename)
+{
+    FILE* file = fopen(filename, "rb");
+    if(file == NULL)
+        return false;
+    unsigned char start[33];
+    size_t read = fread(start, 1, sizeof(start), file);
+    fclose(file);
+    return isPng16FromMemory(start, (int)read);
+}
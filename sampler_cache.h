@@ -0,0 +1,84 @@
+#pragma once
+//Deduplicating cache of samplers, keyed by their create info. Asking for the same sampler state twice returns the
+//same VkSampler, so textures can each ask for what they want without running into maxSamplerAllocationCount.
+//pNext chains aren't part of the key and must be NULL.
+//Safe to call from any thread.
+
+#include <vulkan/vulkan.h>
+#include "hash.h"
+
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+class SamplerCache
+{
+public:
+    //Returns VK_NULL_HANDLE on failure
+    VkSampler getSampler(VkDevice device, const VkSamplerCreateInfo& samplerInfo)
+    {
+        if(samplerInfo.pNext != NULL)
+            return VK_NULL_HANDLE;
+
+        SamplerKey key = makeKey(samplerInfo);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        auto found = samplers.find(key);
+        if(found != samplers.end())
+            return found->second;
+
+        VkSampler sampler;
+        if(vkCreateSampler(device, &samplerInfo, NULL, &sampler) != VK_SUCCESS)
+            return VK_NULL_HANDLE;
+        samplers.emplace(key, sampler);
+        return sampler;
+    }
+
+    size_t getSamplerCount()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return samplers.size();
+    }
+
+    //Only once nothing created with these samplers (including set layouts they're immutable in) is in use
+    void destroyAll(VkDevice device)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for(auto& entry : samplers)
+            vkDestroySampler(device, entry.second, NULL);
+        samplers.clear();
+    }
+
+private:
+    typedef std::vector<uint64_t> SamplerKey;
+
+    //Floats by bit pattern, so -0.0 and 0.0 are different samplers; harmless, just not deduplicated
+    static uint64_t floatWord(float value)
+    {
+        uint32_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        return bits;
+    }
+
+    static SamplerKey makeKey(const VkSamplerCreateInfo& samplerInfo)
+    {
+        SamplerKey key;
+        key.push_back(samplerInfo.flags);
+        key.push_back(((uint64_t)samplerInfo.magFilter << 32) | samplerInfo.minFilter);
+        key.push_back(samplerInfo.mipmapMode);
+        key.push_back(((uint64_t)samplerInfo.addressModeU << 32) | samplerInfo.addressModeV);
+        key.push_back(samplerInfo.addressModeW);
+        key.push_back(floatWord(samplerInfo.mipLodBias));
+        key.push_back(samplerInfo.anisotropyEnable ? floatWord(samplerInfo.maxAnisotropy) : UINT64_MAX);
+        key.push_back(samplerInfo.compareEnable ? (uint64_t)samplerInfo.compareOp : UINT64_MAX);
+        key.push_back((floatWord(samplerInfo.minLod) << 32) | floatWord(samplerInfo.maxLod));
+        key.push_back(samplerInfo.borderColor);
+        key.push_back(samplerInfo.unnormalizedCoordinates);
+        return key;
+    }
+
+    std::unordered_map<SamplerKey, VkSampler, WordKeyHash> samplers;
+    std::mutex mutex;
+};
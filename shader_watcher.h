@@ -0,0 +1,149 @@
+#pragma once
+//Watches a set of files in one directory and reports which ones were rewritten.
+//Uses inotify on Linux; elsewhere falls back to polling modification times.
+
+#include <atomic>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+#else
+#include <chrono>
+#include <map>
+#include <sys/stat.h>
+#include <sys/types.h>
+#endif
+
+class ShaderWatcher
+{
+public:
+    ~ShaderWatcher()
+    {
+        stop();
+    }
+
+    //directory should end in a path separator. Returns false if the directory can't be watched.
+    bool start(const std::string& directory, const std::vector<std::string>& fileNames)
+    {
+        stop();
+        watchDirectory = directory;
+        watchedFiles = std::set<std::string>(fileNames.begin(), fileNames.end());
+
+#ifdef __linux__
+        inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if(inotifyFd < 0)
+            return false;
+        //Compilers either write in place (close-after-write) or write elsewhere and rename over the file (moved-to)
+        if(inotify_add_watch(inotifyFd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0)
+        {
+            close(inotifyFd);
+            inotifyFd = -1;
+            return false;
+        }
+#else
+        for(const std::string& fileName : watchedFiles)
+            modifiedTimes[fileName] = getModifiedTime(fileName);
+#endif
+
+        running = true;
+        watchThread = std::thread([this]() { watchLoop(); });
+        return true;
+    }
+
+    void stop()
+    {
+        if(!running)
+            return;
+        running = false;
+        watchThread.join();
+#ifdef __linux__
+        close(inotifyFd);
+        inotifyFd = -1;
+#endif
+    }
+
+    //Returns the file names changed since the last call, and forgets them
+    std::vector<std::string> takeChangedFiles()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::vector<std::string> files(changedFiles.begin(), changedFiles.end());
+        changedFiles.clear();
+        return files;
+    }
+
+private:
+    void markChanged(const std::string& fileName)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        changedFiles.insert(fileName);
+    }
+
+#ifdef __linux__
+    void watchLoop()
+    {
+        alignas(struct inotify_event) char buffer[4096];
+        while(running)
+        {
+            //Wake up periodically to check whether we've been stopped
+            pollfd pollInfo = { inotifyFd, POLLIN, 0 };
+            if(poll(&pollInfo, 1, 100) <= 0)
+                continue;
+
+            ssize_t length;
+            while((length = read(inotifyFd, buffer, sizeof(buffer))) > 0)
+            {
+                for(char* p = buffer; p < buffer + length; )
+                {
+                    const struct inotify_event* event = (const struct inotify_event*)p;
+                    if(event->len > 0 && watchedFiles.count(event->name))
+                        markChanged(event->name);
+                    p += sizeof(struct inotify_event) + event->len;
+                }
+            }
+        }
+    }
+#else
+    long long getModifiedTime(const std::string& fileName)
+    {
+        struct stat info;
+        if(stat((watchDirectory + fileName).c_str(), &info) != 0)
+            return 0;
+        return (long long)info.st_mtime;
+    }
+
+    void watchLoop()
+    {
+        while(running)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(250));
+            for(const std::string& fileName : watchedFiles)
+            {
+                long long modifiedTime = getModifiedTime(fileName);
+                if(modifiedTime != 0 && modifiedTime != modifiedTimes[fileName])
+                {
+                    modifiedTimes[fileName] = modifiedTime;
+                    markChanged(fileName);
+                }
+            }
+        }
+    }
+
+    std::map<std::string, long long> modifiedTimes;
+#endif
+
+    std::string watchDirectory;
+    std::set<std::string> watchedFiles;
+    std::set<std::string> changedFiles;
+    std::mutex mutex;
+    std::thread watchThread;
+    std::atomic<bool> running{ false };
+#ifdef __linux__
+    int inotifyFd = -1;
+#endif
+};
@@ -0,0 +1,492 @@
+#pragma once
+//Minimal SPIR-V reflection: walks a shader module's bytecode and reports the descriptor bindings, push constant
+//block and (for vertex shaders) vertex inputs it declares, so layouts don't have to be kept in sync with the
+//shaders by hand. Only understands what GLSL compiled with glslangValidator produces for graphics shaders.
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+struct ReflectedBinding
+{
+    uint32_t set;
+    uint32_t binding;
+    VkDescriptorType descriptorType;
+    uint32_t descriptorCount;       //0 for an unsized array
+    VkShaderStageFlags stageFlags;
+};
+
+struct ReflectedVertexInput
+{
+    uint32_t location;
+    VkFormat format;
+    uint32_t size;                  //In bytes
+};
+
+struct ShaderReflection
+{
+    VkShaderStageFlags stageFlags = 0;
+    std::vector<ReflectedBinding> bindings;         //Sorted by set, then binding
+    std::vector<ReflectedVertexInput> vertexInputs; //Vertex shaders only; sorted by location
+    uint32_t pushConstantSize = 0;
+    VkShaderStageFlags pushConstantStageFlags = 0;
+};
+
+namespace spirv
+{
+    //The handful of SPIR-V enum values we care about
+    enum
+    {
+        MAGIC = 0x07230203,
+        HEADER_WORDS = 5,
+
+        OP_ENTRY_POINT = 15,
+        OP_TYPE_BOOL = 20,
+        OP_TYPE_INT = 21,
+        OP_TYPE_FLOAT = 22,
+        OP_TYPE_VECTOR = 23,
+        OP_TYPE_MATRIX = 24,
+        OP_TYPE_IMAGE = 25,
+        OP_TYPE_SAMPLER = 26,
+        OP_TYPE_SAMPLED_IMAGE = 27,
+        OP_TYPE_ARRAY = 28,
+        OP_TYPE_RUNTIME_ARRAY = 29,
+        OP_TYPE_STRUCT = 30,
+        OP_TYPE_POINTER = 32,
+        OP_CONSTANT = 43,
+        OP_VARIABLE = 59,
+        OP_DECORATE = 71,
+        OP_MEMBER_DECORATE = 72,
+
+        DECORATION_BLOCK = 2,
+        DECORATION_BUFFER_BLOCK = 3,
+        DECORATION_ARRAY_STRIDE = 6,
+        DECORATION_MATRIX_STRIDE = 7,
+        DECORATION_BUILT_IN = 11,
+        DECORATION_LOCATION = 30,
+        DECORATION_BINDING = 33,
+        DECORATION_DESCRIPTOR_SET = 34,
+        DECORATION_OFFSET = 35,
+
+        STORAGE_UNIFORM_CONSTANT = 0,
+        STORAGE_INPUT = 1,
+        STORAGE_UNIFORM = 2,
+        STORAGE_PUSH_CONSTANT = 9,
+        STORAGE_STORAGE_BUFFER = 12,
+
+        DIM_BUFFER = 5,
+        DIM_SUBPASS_DATA = 6
+    };
+
+    struct Type
+    {
+        uint32_t opcode = 0;
+        uint32_t component = 0;         //Element/column/pointee type id, or sampled image's image type
+        uint32_t count = 0;             //Vector size, matrix columns, array length constant id, or bit width
+        uint32_t signedness = 0;
+        uint32_t dim = 0;
+        uint32_t sampled = 0;
+        uint32_t storageClass = 0;
+        std::vector<uint32_t> members;
+        std::vector<uint32_t> memberOffsets;
+        uint32_t arrayStride = 0;
+        uint32_t matrixStride = 0;      //From the last matrix member decorated, good enough for size calculation
+        bool block = false;
+        bool bufferBlock = false;
+        bool builtIn = false;
+    };
+
+    struct Variable
+    {
+        uint32_t type = 0;
+        uint32_t storageClass = 0;
+        uint32_t set = 0;
+        uint32_t binding = 0;
+        uint32_t location = 0;
+        bool hasLocation = false;
+        bool builtIn = false;
+    };
+
+    class Module
+    {
+    public:
+        bool parse(const uint32_t* code, size_t codeSize, ShaderReflection& reflection)
+        {
+            size_t wordCount = codeSize / sizeof(uint32_t);
+            if(wordCount < HEADER_WORDS || code[0] != MAGIC)
+                return false;
+
+            for(size_t i = HEADER_WORDS; i < wordCount; )
+            {
+                uint32_t opcode = code[i] & 0xFFFF;
+                uint32_t length = code[i] >> 16;
+                if(length == 0 || i + length > wordCount)
+                    return false;
+                parseInstruction(opcode, &code[i + 1], length - 1, reflection);
+                i += length;
+            }
+
+            for(const auto& entry : variables)
+            {
+                if(!addVariable(entry.second, reflection))
+                    return false;
+            }
+
+            std::sort(reflection.bindings.begin(), reflection.bindings.end(), [](const ReflectedBinding& a, const ReflectedBinding& b)
+            {
+                return (a.set != b.set) ? a.set < b.set : a.binding < b.binding;
+            });
+            std::sort(reflection.vertexInputs.begin(), reflection.vertexInputs.end(), [](const ReflectedVertexInput& a, const ReflectedVertexInput& b)
+            {
+                return a.location < b.location;
+            });
+            return true;
+        }
+
+    private:
+        void parseInstruction(uint32_t opcode, const uint32_t* operands, uint32_t operandCount, ShaderReflection& reflection)
+        {
+            switch(opcode)
+            {
+            case OP_ENTRY_POINT:
+                if(operandCount >= 1)
+                    reflection.stageFlags |= getStage(operands[0]);
+                break;
+            case OP_TYPE_BOOL:
+            case OP_TYPE_SAMPLER:
+                if(operandCount >= 1)
+                    types[operands[0]].opcode = opcode;
+                break;
+            case OP_TYPE_INT:
+            case OP_TYPE_FLOAT:
+                if(operandCount >= 2)
+                {
+                    Type& type = types[operands[0]];
+                    type.opcode = opcode;
+                    type.count = operands[1];
+                    type.signedness = (opcode == OP_TYPE_INT && operandCount >= 3) ? operands[2] : 0;
+                }
+                break;
+            case OP_TYPE_VECTOR:
+            case OP_TYPE_MATRIX:
+            case OP_TYPE_ARRAY:
+                if(operandCount >= 3)
+                {
+                    Type& type = types[operands[0]];
+                    type.opcode = opcode;
+                    type.component = operands[1];
+                    type.count = operands[2];
+                }
+                break;
+            case OP_TYPE_RUNTIME_ARRAY:
+            case OP_TYPE_SAMPLED_IMAGE:
+                if(operandCount >= 2)
+                {
+                    Type& type = types[operands[0]];
+                    type.opcode = opcode;
+                    type.component = operands[1];
+                }
+                break;
+            case OP_TYPE_IMAGE:
+                if(operandCount >= 7)
+                {
+                    Type& type = types[operands[0]];
+                    type.opcode = opcode;
+                    type.dim = operands[2];
+                    type.sampled = operands[6];
+                }
+                break;
+            case OP_TYPE_STRUCT:
+                if(operandCount >= 1)
+                {
+                    Type& type = types[operands[0]];
+                    type.opcode = opcode;
+                    type.members.assign(operands + 1, operands + operandCount);
+                    type.memberOffsets.resize(type.members.size(), 0);
+                }
+                break;
+            case OP_TYPE_POINTER:
+                if(operandCount >= 3)
+                {
+                    Type& type = types[operands[0]];
+                    type.opcode = opcode;
+                    type.storageClass = operands[1];
+                    type.component = operands[2];
+                }
+                break;
+            case OP_CONSTANT:
+                if(operandCount >= 3)
+                    constants[operands[1]] = operands[2];
+                break;
+            case OP_VARIABLE:
+                if(operandCount >= 3)
+                {
+                    Variable& variable = variables[operands[1]];
+                    variable.type = operands[0];
+                    variable.storageClass = operands[2];
+                }
+                break;
+            case OP_DECORATE:
+                if(operandCount >= 2)
+                    decorate(operands[0], operands[1], (operandCount >= 3) ? operands[2] : 0);
+                break;
+            case OP_MEMBER_DECORATE:
+                if(operandCount >= 3)
+                {
+                    Type& type = types[operands[0]];
+                    uint32_t value = (operandCount >= 4) ? operands[3] : 0;
+                    if(operands[2] == DECORATION_BUILT_IN)
+                        type.builtIn = true;
+                    else if(operands[2] == DECORATION_OFFSET)
+                    {
+                        if(type.memberOffsets.size() <= operands[1])
+                            type.memberOffsets.resize(operands[1] + 1, 0);
+                        type.memberOffsets[operands[1]] = value;
+                    }
+                    else if(operands[2] == DECORATION_MATRIX_STRIDE)
+                        type.matrixStride = value;
+                }
+                break;
+            }
+        }
+
+        //Decorations can come before the variable or type they target, so both maps are filled in lazily
+        void decorate(uint32_t target, uint32_t decoration, uint32_t value)
+        {
+            switch(decoration)
+            {
+            case DECORATION_DESCRIPTOR_SET: variables[target].set = value; break;
+            case DECORATION_BINDING: variables[target].binding = value; break;
+            case DECORATION_LOCATION: variables[target].location = value; variables[target].hasLocation = true; break;
+            case DECORATION_BUILT_IN: variables[target].builtIn = true; break;
+            case DECORATION_BLOCK: types[target].block = true; break;
+            case DECORATION_BUFFER_BLOCK: types[target].bufferBlock = true; break;
+            case DECORATION_ARRAY_STRIDE: types[target].arrayStride = value; break;
+            }
+        }
+
+        static VkShaderStageFlags getStage(uint32_t executionModel)
+        {
+            switch(executionModel)
+            {
+            case 0: return VK_SHADER_STAGE_VERTEX_BIT;
+            case 1: return VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT;
+            case 2: return VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT;
+            case 3: return VK_SHADER_STAGE_GEOMETRY_BIT;
+            case 4: return VK_SHADER_STAGE_FRAGMENT_BIT;
+            case 5: return VK_SHADER_STAGE_COMPUTE_BIT;
+            }
+            return 0;
+        }
+
+        bool addVariable(const Variable& variable, ShaderReflection& reflection)
+        {
+            //Decorations on ids that turned out not to be variables
+            if(variable.type == 0)
+                return true;
+
+            const Type& pointer = types[variable.type];
+            uint32_t typeId = pointer.component;
+
+            switch(variable.storageClass)
+            {
+            case STORAGE_INPUT:
+                if(!(reflection.stageFlags & VK_SHADER_STAGE_VERTEX_BIT) || variable.builtIn || types[typeId].builtIn)
+                    return true;
+                return addVertexInput(variable, typeId, reflection);
+            case STORAGE_PUSH_CONSTANT:
+                reflection.pushConstantSize = std::max(reflection.pushConstantSize, getSize(typeId));
+                reflection.pushConstantStageFlags = reflection.stageFlags;
+                return true;
+            case STORAGE_UNIFORM_CONSTANT:
+            case STORAGE_UNIFORM:
+            case STORAGE_STORAGE_BUFFER:
+                return addBinding(variable, typeId, reflection);
+            }
+            return true;
+        }
+
+        bool addBinding(const Variable& variable, uint32_t typeId, ShaderReflection& reflection)
+        {
+            ReflectedBinding binding = {};
+            binding.set = variable.set;
+            binding.binding = variable.binding;
+            binding.descriptorCount = 1;
+            binding.stageFlags = reflection.stageFlags;
+
+            //Arrays of resources become arrayed bindings
+            const Type* type = &types[typeId];
+            if(type->opcode == OP_TYPE_ARRAY)
+            {
+                binding.descriptorCount = constants[type->count];
+                type = &types[type->component];
+            }
+            else if(type->opcode == OP_TYPE_RUNTIME_ARRAY)
+            {
+                binding.descriptorCount = 0;
+                type = &types[type->component];
+            }
+
+            switch(type->opcode)
+            {
+            case OP_TYPE_SAMPLER:
+                binding.descriptorType = VK_DESCRIPTOR_TYPE_SAMPLER;
+                break;
+            case OP_TYPE_SAMPLED_IMAGE:
+                binding.descriptorType = (types[type->component].dim == DIM_BUFFER) ? VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER : VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+                break;
+            case OP_TYPE_IMAGE:
+                if(type->dim == DIM_SUBPASS_DATA)
+                    binding.descriptorType = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+                else if(type->dim == DIM_BUFFER)
+                    binding.descriptorType = (type->sampled == 2) ? VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER;
+                else
+                    binding.descriptorType = (type->sampled == 2) ? VK_DESCRIPTOR_TYPE_STORAGE_IMAGE : VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+                break;
+            case OP_TYPE_STRUCT:
+                if(variable.storageClass == STORAGE_STORAGE_BUFFER || type->bufferBlock)
+                    binding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+                else
+                    binding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+                break;
+            default:
+                return false;
+            }
+
+            reflection.bindings.push_back(binding);
+            return true;
+        }
+
+        bool addVertexInput(const Variable& variable, uint32_t typeId, ShaderReflection& reflection)
+        {
+            if(!variable.hasLocation)
+                return false;
+
+            const Type& type = types[typeId];
+            const Type& scalar = (type.opcode == OP_TYPE_VECTOR) ? types[type.component] : type;
+            uint32_t componentCount = (type.opcode == OP_TYPE_VECTOR) ? type.count : 1;
+            if(scalar.count != 32 || componentCount < 1 || componentCount > 4)
+                return false;   //Matrices, arrays and 16/64-bit inputs aren't supported
+
+            static const VkFormat floatFormats[] = { VK_FORMAT_R32_SFLOAT, VK_FORMAT_R32G32_SFLOAT, VK_FORMAT_R32G32B32_SFLOAT, VK_FORMAT_R32G32B32A32_SFLOAT };
+            static const VkFormat intFormats[] = { VK_FORMAT_R32_SINT, VK_FORMAT_R32G32_SINT, VK_FORMAT_R32G32B32_SINT, VK_FORMAT_R32G32B32A32_SINT };
+            static const VkFormat uintFormats[] = { VK_FORMAT_R32_UINT, VK_FORMAT_R32G32_UINT, VK_FORMAT_R32G32B32_UINT, VK_FORMAT_R32G32B32A32_UINT };
+
+            ReflectedVertexInput input = {};
+            input.location = variable.location;
+            input.size = componentCount * sizeof(uint32_t);
+            if(scalar.opcode == OP_TYPE_FLOAT)
+                input.format = floatFormats[componentCount - 1];
+            else if(scalar.opcode == OP_TYPE_INT)
+                input.format = scalar.signedness ? intFormats[componentCount - 1] : uintFormats[componentCount - 1];
+            else
+                return false;
+
+            reflection.vertexInputs.push_back(input);
+            return true;
+        }
+
+        //Size in bytes of a type laid out in a block, using the explicit offsets and strides glslang decorates it with
+        uint32_t getSize(uint32_t typeId)
+        {
+            const Type& type = types[typeId];
+            switch(type.opcode)
+            {
+            case OP_TYPE_BOOL:
+                return 4;
+            case OP_TYPE_INT:
+            case OP_TYPE_FLOAT:
+                return type.count / 8;
+            case OP_TYPE_VECTOR:
+                return type.count * getSize(type.component);
+            case OP_TYPE_MATRIX:
+                return type.count * (type.matrixStride ? type.matrixStride : getSize(type.component));
+            case OP_TYPE_ARRAY:
+                return constants[type.count] * (type.arrayStride ? type.arrayStride : getSize(type.component));
+            case OP_TYPE_STRUCT:
+            {
+                uint32_t size = 0;
+                for(size_t i = 0; i < type.members.size(); i++)
+                {
+                    //Matrix members carry their stride on the struct, not the matrix type
+                    uint32_t memberSize = getSize(type.members[i]);
+                    if(types[type.members[i]].opcode == OP_TYPE_MATRIX && type.matrixStride)
+                        memberSize = types[type.members[i]].count * type.matrixStride;
+                    size = std::max(size, type.memberOffsets[i] + memberSize);
+                }
+                return size;
+            }
+            }
+            return 0;
+        }
+
+        std::unordered_map<uint32_t, Type> types;
+        std::unordered_map<uint32_t, Variable> variables;
+        std::unordered_map<uint32_t, uint32_t> constants;
+    };
+}
+
+//codeSize in bytes. Returns false if the bytecode isn't valid SPIR-V or declares an interface this can't describe.
+inline bool reflectSpirv(const uint32_t* code, size_t codeSize, ShaderReflection& reflection)
+{
+    reflection = ShaderReflection();
+    spirv::Module module;
+    return module.parse(code, codeSize, reflection);
+}
+
+//Combines the interfaces of the stages in one pipeline. Returns false if they declare the same binding differently.
+inline bool mergeShaderReflection(const ShaderReflection& stage, ShaderReflection& pipeline)
+{
+    for(const ReflectedBinding& binding : stage.bindings)
+    {
+        auto found = std::find_if(pipeline.bindings.begin(), pipeline.bindings.end(), [&binding](const ReflectedBinding& existing)
+        {
+            return existing.set == binding.set && existing.binding == binding.binding;
+        });
+        if(found == pipeline.bindings.end())
+            pipeline.bindings.push_back(binding);
+        else if(found->descriptorType != binding.descriptorType || found->descriptorCount != binding.descriptorCount)
+            return false;
+        else
+            found->stageFlags |= binding.stageFlags;
+    }
+    std::sort(pipeline.bindings.begin(), pipeline.bindings.end(), [](const ReflectedBinding& a, const ReflectedBinding& b)
+    {
+        return (a.set != b.set) ? a.set < b.set : a.binding < b.binding;
+    });
+
+    if(stage.stageFlags & VK_SHADER_STAGE_VERTEX_BIT)
+        pipeline.vertexInputs = stage.vertexInputs;
+    if(stage.pushConstantSize > 0)
+    {
+        pipeline.pushConstantSize = std::max(pipeline.pushConstantSize, stage.pushConstantSize);
+        pipeline.pushConstantStageFlags |= stage.pushConstantStageFlags;
+    }
+    pipeline.stageFlags |= stage.stageFlags;
+    return true;
+}
+
+//Vertex attributes for one interleaved binding, packed tightly in location order: the inputs at locations
+//[firstLocation, endLocation). Appends to attributes and returns the stride.
+inline uint32_t getReflectedVertexAttributes(const ShaderReflection& reflection, uint32_t binding, std::vector<VkVertexInputAttributeDescription>& attributes,
+    uint32_t firstLocation = 0, uint32_t endLocation = UINT32_MAX)
+{
+    uint32_t offset = 0;
+    for(const ReflectedVertexInput& input : reflection.vertexInputs)
+    {
+        if(input.location < firstLocation || input.location >= endLocation)
+            continue;
+
+        VkVertexInputAttributeDescription attribute = {};
+        attribute.binding = binding;
+        attribute.location = input.location;
+        attribute.format = input.format;
+        attribute.offset = offset;
+        attributes.push_back(attribute);
+        offset += input.size;
+    }
+    return offset;
+}
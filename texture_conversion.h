@@ -0,0 +1,245 @@
+#pragma once
+//Texel conversion kernels for uploading HDR and 16-bit textures to half-float GPU formats.
+//The vector path is picked at compile time: F16C when building for AVX2/F16C, SSE2 on any x86-64,
+//and a scalar fallback everywhere else. All paths produce bit-identical results.
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+//MSVC has no __F16C__, but every AVX2 target has F16C
+#if defined(__F16C__) || (defined(_MSC_VER) && defined(__AVX2__))
+#define TEXTURE_CONVERSION_F16C
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TEXTURE_CONVERSION_SSE2
+#include <emmintrin.h>
+#endif
+
+//Largest finite values of the unsigned 11-bit (6 mantissa bits) and 10-bit (5 mantissa bits) floats
+#define PACKED_FLOAT11_MAX 65024.0f
+#define PACKED_FLOAT10_MAX 64512.0f
+
+inline uint32_t floatBits(float f)
+{
+    uint32_t u;
+    memcpy(&u, &f, sizeof(u));
+    return u;
+}
+
+inline float bitsFloat(uint32_t u)
+{
+    float f;
+    memcpy(&f, &u, sizeof(f));
+    return f;
+}
+
+//Float to IEEE half, round to nearest even. Overflow goes to infinity; NaN stays NaN (quieted, top payload bits kept, like F16C).
+inline uint16_t floatToHalf(float value)
+{
+    const uint32_t f32Infinity = 255 << 23;
+    const uint32_t f16Max = (127 + 16) << 23;
+    const uint32_t denormMagic = ((127 - 15) + (23 - 10) + 1) << 23;
+
+    uint32_t f = floatBits(value);
+    uint32_t sign = f & 0x80000000u;
+    uint32_t out;
+    f ^= sign;
+
+    if(f >= f16Max)
+        out = (f > f32Infinity) ? (0x7E00 | ((f >> 13) & 0x3FF)) : 0x7C00;
+    else if(f < (113u << 23))
+    {
+        //Result is subnormal; let the FPU do the rounding by adding a magic number
+        out = floatBits(bitsFloat(f) + bitsFloat(denormMagic)) - denormMagic;
+    }
+    else
+    {
+        uint32_t mantissaOdd = (f >> 13) & 1;
+        f += ((uint32_t)(15 - 127) << 23) + 0xFFF;
+        f += mantissaOdd;
+        out = f >> 13;
+    }
+
+    return (uint16_t)(out | (sign >> 16));
+}
+
+//Float (already clamped with clampPackedFloat) to an unsigned 11- or 10-bit float with mantissaBits of mantissa,
+//rounding to nearest even straight from the float's mantissa. Same approach as floatToHalf, whose exponent range
+//the packed formats share; the clamp keeps it from rounding up past the largest finite value.
+inline uint32_t floatToPackedFloat(float value, uint32_t mantissaBits)
+{
+    const uint32_t dropBits = 23 - mantissaBits;
+    const uint32_t denormMagic = ((127 - 15) + dropBits + 1) << 23;
+
+    uint32_t f = floatBits(value);
+    if(f < (113u << 23))
+    {
+        //Result is subnormal; let the FPU do the rounding by adding a magic number
+        return floatBits(value + bitsFloat(denormMagic)) - denormMagic;
+    }
+
+    uint32_t mantissaOdd = (f >> dropBits) & 1;
+    f += ((uint32_t)(15 - 127) << 23) + (1u << (dropBits - 1)) - 1;
+    f += mantissaOdd;
+    return f >> dropBits;
+}
+
+//Negatives and NaN to 0, and anything past maxFinite (PACKED_FLOAT11_MAX or PACKED_FLOAT10_MAX) to it
+inline float clampPackedFloat(float value, float maxFinite)
+{
+    //Written so NaN fails the first test and becomes zero
+    if(!(value > 0.0f))
+        return 0.0f;
+    if(value > maxFinite)
+        return maxFinite;
+    return value;
+}
+
+#if defined(TEXTURE_CONVERSION_SSE2)
+//Four floats to four halves held in the low 16 bits of each 32-bit lane. Matches floatToHalf bit for bit.
+inline __m128i floatToHalfSSE2(__m128 f)
+{
+    const __m128i signMask = _mm_set1_epi32(0x80000000);
+    const __m128i f16Max = _mm_set1_epi32((127 + 16) << 23);
+    const __m128i nanBits = _mm_set1_epi32(0x200);
+    const __m128i mantissaMask = _mm_set1_epi32(0x3FF);
+    const __m128i infinityAsHalf = _mm_set1_epi32(0x7C00);
+    const __m128i minNormal = _mm_set1_epi32((127 - 14) << 23);
+    const __m128i subnormalMagic = _mm_set1_epi32(((127 - 15) + (23 - 10) + 1) << 23);
+    const __m128i normalBias = _mm_set1_epi32(0xFFF - ((127 - 15) << 23));
+
+    __m128i bits = _mm_castps_si128(f);
+    __m128i justSign = _mm_and_si128(bits, signMask);
+    __m128i absBits = _mm_xor_si128(bits, justSign);
+    __m128 absF = _mm_castsi128_ps(absBits);
+
+    __m128i isNan = _mm_castps_si128(_mm_cmpunord_ps(absF, absF));
+    __m128i isRegular = _mm_cmpgt_epi32(f16Max, absBits);
+    __m128i nanPayload = _mm_or_si128(nanBits, _mm_and_si128(_mm_srli_epi32(absBits, 13), mantissaMask));
+    __m128i infOrNan = _mm_or_si128(_mm_and_si128(isNan, nanPayload), infinityAsHalf);
+
+    __m128i isSubnormal = _mm_cmpgt_epi32(minNormal, absBits);
+    __m128i subnormal = _mm_sub_epi32(_mm_castps_si128(_mm_add_ps(absF, _mm_castsi128_ps(subnormalMagic))), subnormalMagic);
+
+    __m128i mantissaOdd = _mm_srai_epi32(_mm_slli_epi32(absBits, 31 - 13), 31);
+    __m128i normal = _mm_srli_epi32(_mm_sub_epi32(_mm_add_epi32(absBits, normalBias), mantissaOdd), 13);
+
+    __m128i finite = _mm_or_si128(_mm_and_si128(isSubnormal, subnormal), _mm_andnot_si128(isSubnormal, normal));
+    __m128i result = _mm_or_si128(_mm_and_si128(isRegular, finite), _mm_andnot_si128(isRegular, infOrNan));
+    return _mm_or_si128(result, _mm_srli_epi32(justSign, 16));
+}
+#endif
+
+#if defined(TEXTURE_CONVERSION_F16C) || defined(TEXTURE_CONVERSION_SSE2)
+//Same as floatToPackedFloat, four lanes at a time. F16C can't help here: going through half would round twice.
+//The inputs are clamped, so non-negative and finite, and their bit patterns compare correctly as signed integers.
+inline __m128i floatToPackedFloatLanes(__m128 f, int mantissaBits)
+{
+    const int dropBits = 23 - mantissaBits;
+    const __m128i minNormal = _mm_set1_epi32((127 - 14) << 23);
+    const __m128i subnormalMagic = _mm_set1_epi32(((127 - 15) + dropBits + 1) << 23);
+    const __m128i normalBias = _mm_set1_epi32((int)(((uint32_t)(15 - 127) << 23) + (1u << (dropBits - 1)) - 1));
+    const __m128i shift = _mm_cvtsi32_si128(dropBits);
+
+    __m128i bits = _mm_castps_si128(f);
+    __m128i isSubnormal = _mm_cmpgt_epi32(minNormal, bits);
+    __m128i subnormal = _mm_sub_epi32(_mm_castps_si128(_mm_add_ps(f, _mm_castsi128_ps(subnormalMagic))), subnormalMagic);
+
+    __m128i mantissaOdd = _mm_and_si128(_mm_srl_epi32(bits, shift), _mm_set1_epi32(1));
+    __m128i normal = _mm_srl_epi32(_mm_add_epi32(_mm_add_epi32(bits, normalBias), mantissaOdd), shift);
+    return _mm_or_si128(_mm_and_si128(isSubnormal, subnormal), _mm_andnot_si128(isSubnormal, normal));
+}
+#endif
+
+//Convert count floats to halves (e.g. RGBA32F to VK_FORMAT_R16G16B16A16_SFLOAT)
+inline void convertFloatToHalf(const float* src, uint16_t* dst, size_t count)
+{
+    size_t i = 0;
+#if defined(TEXTURE_CONVERSION_F16C)
+    for(; i + 8 <= count; i += 8)
+        _mm_storeu_si128((__m128i*)(dst + i), _mm256_cvtps_ph(_mm256_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT));
+#elif defined(TEXTURE_CONVERSION_SSE2)
+    for(; i + 8 <= count; i += 8)
+    {
+        //Sign-extend so the saturating pack leaves the 16-bit patterns untouched
+        __m128i lo = floatToHalfSSE2(_mm_loadu_ps(src + i));
+        __m128i hi = floatToHalfSSE2(_mm_loadu_ps(src + i + 4));
+        lo = _mm_srai_epi32(_mm_slli_epi32(lo, 16), 16);
+        hi = _mm_srai_epi32(_mm_slli_epi32(hi, 16), 16);
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_packs_epi32(lo, hi));
+    }
+#endif
+    for(; i < count; i++)
+        dst[i] = floatToHalf(src[i]);
+}
+
+//Convert count 16-bit unorm values to halves in [0, 1] (e.g. 16-bit PNG to VK_FORMAT_R16G16B16A16_SFLOAT)
+inline void convertUnorm16ToHalf(const uint16_t* src, uint16_t* dst, size_t count)
+{
+    const float scale = 1.0f / 65535.0f;
+    size_t i = 0;
+#if defined(TEXTURE_CONVERSION_F16C)
+    const __m128 scale4 = _mm_set1_ps(scale);
+    const __m128i zero = _mm_setzero_si128();
+    for(; i + 8 <= count; i += 8)
+    {
+        __m128i in = _mm_loadu_si128((const __m128i*)(src + i));
+        __m128i lo = _mm_cvtps_ph(_mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(in, zero)), scale4), _MM_FROUND_TO_NEAREST_INT);
+        __m128i hi = _mm_cvtps_ph(_mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(in, zero)), scale4), _MM_FROUND_TO_NEAREST_INT);
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_unpacklo_epi64(lo, hi));
+    }
+#elif defined(TEXTURE_CONVERSION_SSE2)
+    const __m128 scale4 = _mm_set1_ps(scale);
+    const __m128i zero = _mm_setzero_si128();
+    for(; i + 8 <= count; i += 8)
+    {
+        __m128i in = _mm_loadu_si128((const __m128i*)(src + i));
+        __m128i lo = floatToHalfSSE2(_mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(in, zero)), scale4));
+        __m128i hi = floatToHalfSSE2(_mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(in, zero)), scale4));
+        lo = _mm_srai_epi32(_mm_slli_epi32(lo, 16), 16);
+        hi = _mm_srai_epi32(_mm_slli_epi32(hi, 16), 16);
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_packs_epi32(lo, hi));
+    }
+#endif
+    for(; i < count; i++)
+        dst[i] = floatToHalf((float)src[i] * scale);
+}
+
+//Pack RGBA32F pixels into VK_FORMAT_B10G11R11_UFLOAT_PACK32. Alpha is dropped, negatives and NaN become 0,
+//and values past the format's range clamp to its largest finite value.
+inline void packRgbaFloatToB10G11R11(const float* rgba, uint32_t* dst, size_t pixelCount)
+{
+    size_t i = 0;
+#if defined(TEXTURE_CONVERSION_F16C) || defined(TEXTURE_CONVERSION_SSE2)
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 float11Max = _mm_set1_ps(PACKED_FLOAT11_MAX);
+    const __m128 float10Max = _mm_set1_ps(PACKED_FLOAT10_MAX);
+    for(; i + 4 <= pixelCount; i += 4)
+    {
+        __m128 r = _mm_loadu_ps(rgba + i * 4);
+        __m128 g = _mm_loadu_ps(rgba + i * 4 + 4);
+        __m128 b = _mm_loadu_ps(rgba + i * 4 + 8);
+        __m128 a = _mm_loadu_ps(rgba + i * 4 + 12);
+        _MM_TRANSPOSE4_PS(r, g, b, a);
+
+        //max(x, 0) returns the second operand for NaN, so NaN ends up as 0 like the scalar path
+        r = _mm_min_ps(_mm_max_ps(r, zero), float11Max);
+        g = _mm_min_ps(_mm_max_ps(g, zero), float11Max);
+        b = _mm_min_ps(_mm_max_ps(b, zero), float10Max);
+
+        __m128i packed = floatToPackedFloatLanes(r, 6);
+        packed = _mm_or_si128(packed, _mm_slli_epi32(floatToPackedFloatLanes(g, 6), 11));
+        packed = _mm_or_si128(packed, _mm_slli_epi32(floatToPackedFloatLanes(b, 5), 22));
+        _mm_storeu_si128((__m128i*)(dst + i), packed);
+    }
+#endif
+    for(; i < pixelCount; i++)
+    {
+        const float* p = rgba + i * 4;
+        uint32_t r = floatToPackedFloat(clampPackedFloat(p[0], PACKED_FLOAT11_MAX), 6);
+        uint32_t g = floatToPackedFloat(clampPackedFloat(p[1], PACKED_FLOAT11_MAX), 6);
+        uint32_t b = floatToPackedFloat(clampPackedFloat(p[2], PACKED_FLOAT10_MAX), 5);
+        dst[i] = r | (g << 11) | (b << 22);
+    }
+}
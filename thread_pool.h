@@ -0,0 +1,87 @@
+#pragma once
+//Fixed-size pool of worker threads pulling tasks off a shared FIFO queue
+
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+class ThreadPool
+{
+public:
+    //threadCount of 0 uses one thread per core, minus one for the main thread
+    explicit ThreadPool(size_t threadCount = 0)
+    {
+        if(threadCount == 0)
+        {
+            unsigned int cores = std::thread::hardware_concurrency();
+            threadCount = (cores > 1) ? cores - 1 : 1;
+        }
+
+        for(size_t i = 0; i < threadCount; i++)
+            workers.emplace_back([this]() { workerLoop(); });
+    }
+
+    //Finishes everything already queued before returning
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wakeCondition.notify_all();
+        for(std::thread& worker : workers)
+            worker.join();
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    template<typename Task>
+    std::future<typename std::result_of<Task()>::type> submit(Task task)
+    {
+        typedef typename std::result_of<Task()>::type Result;
+        auto packagedTask = std::make_shared<std::packaged_task<Result()>>(std::move(task));
+        std::future<Result> result = packagedTask->get_future();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            tasks.push([packagedTask]() { (*packagedTask)(); });
+        }
+        wakeCondition.notify_one();
+        return result;
+    }
+
+    size_t getThreadCount() const
+    {
+        return workers.size();
+    }
+
+private:
+    void workerLoop()
+    {
+        while(true)
+        {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wakeCondition.wait(lock, [this]() { return stopping || !tasks.empty(); });
+                if(tasks.empty())
+                    return;
+                task = std::move(tasks.front());
+                tasks.pop();
+            }
+            task();
+        }
+    }
+
+    std::vector<std::thread> workers;
+    std::queue<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable wakeCondition;
+    bool stopping = false;
+};